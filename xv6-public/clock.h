@@ -0,0 +1,10 @@
+// Clock page mapped read-only into every process,
+// so that user can read the time without system call.
+#define USERCLOCK 0x7FFFF000    // KERNBASE - PGSIZE
+
+struct clock {
+  uint ticks;           // timer ticks since boot, updated by the timer
+  uint tickcycles;      // TSC cycles per tick
+  uint baseticks;       // ticks are counted from TSC since this tick
+  uint64 basetsc;       // TSC at the tick `baseticks`
+};
@@ -4,14 +4,27 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct thread;
+struct timer;
 struct rtcdate;
+struct schedstat;
+struct runtime;
+struct schedparam;
+struct dlstat;
+struct traceev;
+struct clock;
 struct spinlock;
 struct sleeplock;
+struct slab;
 struct stat;
 struct superblock;
 
 struct stride;
+struct eevdf;
+struct edf;
 struct mlfq;
+struct runlist;
+struct cpu;
 
 // bio.c
 void            binit(void);
@@ -82,7 +95,9 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(uchar, int);
 void            lapicinit(void);
+void            lapictimer(uint64);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -115,6 +130,9 @@ int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+struct thread*  mythread(void);
+int             killed(void);
+int             killthreads(void);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
@@ -122,15 +140,39 @@ void            sched(void);
 void            next_thread(struct proc*);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             sleepuntil(void*, struct spinlock*, uint);
+void            timerintr(void);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int             getlev(void);
 int             set_cpu_share(int);
+int             set_cpu_fraction(int, int);
+int             set_latency(int, int);
+int             set_deadline(int, int, int);
+int             getdeadline(struct dlstat*);
+int             set_gang(int);
+int             futex_wait(uint*, uint, int);
+int             futex_wake(uint*, int);
+int             thread_getlev(int);
+int             thread_set_cpu_share(int, int);
+int             sched_setaffinity(int, uint);
+int             sched_getaffinity(int);
+int             thread_setaffinity(int, uint);
+int             thread_getaffinity(int);
+void            getschedstat(struct schedstat*);
+void            getschedparam(struct schedparam*);
+int             setschedparam(struct schedparam*);
+void            getruntime(struct runtime*);
+void            thread_discard(struct thread*);
+void            thread_epilogue(void) __attribute__((noreturn));
 int             thread_create(int*, void*(*)(void*), void*);
 void            thread_exit(void*);
 int             thread_join(int, void**);
+int             thread_join_any(void**);
+int             thread_kill(int);
+int             settls(char*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -144,6 +186,11 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// slab.c
+void            slabinit(struct slab*, char*, uint);
+void*           slaballoc(struct slab*);
+void            slabfree(struct slab*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -168,11 +215,30 @@ int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
-void            timerinit(void);
+void            timerinit(uint);
+void            timeradd(struct timer*, uint);
+void            timerdel(struct timer*);
+void            timeradvance(uint, struct timer*);
+uint            timerpeek(void);
+
+// trace.c
+extern volatile int tracing;
+void            traceinit(void);
+void            trace(int, struct proc*, struct thread*);
+int             settrace(int);
+int             gettrace(struct traceev*, int);
+// Record scheduler event only while tracing is enabled.
+#define TRACE(type, p, t) \
+  do { if (tracing) trace(type, p, t); } while (0)
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+extern uint     tickcycles;
+extern struct clock *uclock;
+uint            readticks(void);
+void            clockarm(uint64);
+void            clockwake(uint);
 void            tvinit(void);
 extern struct spinlock tickslock;
 
@@ -188,34 +254,88 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             unmapuvm(pde_t*, uint, uint, char**);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
-void            switch_trap_kstack(struct proc*);
+void            loadtls(struct thread*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             mapclock(pde_t*);
 
 // mlfq.c
 void            stride_init(struct stride*);
 int             stride_append(struct stride*, struct proc*, int);
 void            stride_delete(struct stride*, struct proc*);
-int             stride_update(struct stride*, struct proc*);
-struct proc*    stride_next(struct stride*, int*);
-
-void            mlfq_init(struct mlfq*);
-int             mlfq_append(struct mlfq*, struct proc*, int);
-int             mlfq_cpu_share(struct mlfq*, struct proc*, int);
-void            mlfq_delete(struct mlfq*, struct proc*);
-int             mlfq_update(struct mlfq*, struct proc*, uint);
-struct proc*    mlfq_next(struct mlfq*, int*);
-void            mlfq_boost(struct mlfq*);
-void            mlfq_scheduler(struct mlfq*, struct spinlock*) __attribute__((noreturn));
+int             stride_update(struct stride*, struct proc*, uint64);
+struct proc*    stride_next(struct stride*);
 
+void            mlfq_thread_init(struct thread*);
+int             mlfq_cpu_share(struct proc*, int);
+int             mlfq_latency(struct proc*, int, int);
+int             mlfq_deadline(struct proc*, int, int, int);
+int             mlfq_level(struct mlfq*, struct proc*);
+int             mlfq_thread_level(struct mlfq*, struct thread*);
+int             mlfq_thread_share(struct proc*, struct thread*, int);
+void            mlfq_getparam(struct mlfq*, struct schedparam*);
+int             mlfq_setparam(struct mlfq*, struct schedparam*);
 void            mlfq_log(struct mlfq*, int);
-int             mlfq_yieldable(struct mlfq*, struct proc*);
+
+// eevdf.c
+void            eevdf_init(struct eevdf*);
+int             eevdf_append(struct eevdf*, uint, struct proc*, int, uint64);
+void            eevdf_delete(struct eevdf*, struct proc*);
+void            eevdf_push(struct eevdf*, struct proc*);
+void            eevdf_remove(struct eevdf*, struct proc*);
+void            eevdf_wake(struct eevdf*, struct proc*);
+struct proc*    eevdf_next(struct eevdf*);
+int             eevdf_update(struct eevdf*, struct proc*, uint64);
+uint64          eevdf_remain(struct eevdf*, struct proc*);
+
+// edf.c
+void            edf_init(struct edf*);
+int             edf_append(struct edf*, uint, struct proc*, int);
+void            edf_delete(struct edf*, struct proc*);
+void            edf_push(struct edf*, struct proc*);
+void            edf_remove(struct edf*, struct proc*);
+void            edf_wake(struct edf*, struct proc*);
+struct proc*    edf_next(struct edf*);
+int             edf_update(struct edf*, struct proc*, uint64);
+uint64          edf_remain(struct edf*, struct proc*);
+uint64          edf_until(struct edf*, uint64);
+
+// sched.c
+uint64          cycles(uint);
+void            runlist_append(struct runlist*, struct proc*);
+void            runlist_insert(struct runlist*, struct proc*, struct proc*);
+void            runlist_remove(struct runlist*, struct proc*);
+struct thread*  sched_thread(struct proc*);
+void            sched_unlink(struct proc*, struct thread*);
+void            sched_init(struct mlfq*, struct cpu*);
+struct mlfq*    sched_lock(struct proc*);
+void            sched_lock2(struct mlfq*, struct mlfq*);
+void            sched_append(struct mlfq*, struct proc*);
+void            sched_ready(struct mlfq*, struct proc*, struct thread*);
+void            sched_unready(struct mlfq*, struct proc*, struct thread*);
+void            sched_offcpu(struct proc*, struct thread*);
+void            sched_delete(struct proc*);
+struct proc*    sched_pick(struct mlfq*, struct proc*, struct thread**);
+void            sched_dispatch(struct mlfq*, struct proc*, struct thread*);
+int             sched_done(struct mlfq*, struct proc*, struct thread*, uint64);
+int             sched_movable(struct mlfq*, struct mlfq*, struct proc*);
+int             sched_steal(struct mlfq*);
+void            sched_retry(struct mlfq*, uint64);
+struct mlfq*    sched_place(uint);
+int             sched_migrate(struct proc*, uint);
+void            sched_gang(struct mlfq*, struct proc*);
+struct thread*  sched_follow(struct mlfq*);
+void            sched_preempt(struct mlfq*);
+void            sched_idle(struct mlfq*);
+int             sched_yieldable(struct mlfq*, struct proc*);
+uint64          sched_timeout(struct mlfq*, struct proc*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
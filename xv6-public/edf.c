@@ -0,0 +1,180 @@
+// Earliest deadline first scheduler for periodic clients.
+// Client reserves `runtime` of cpu in every period, and the job of
+// a period should be done within `deadline` from the start of the period.
+// Client having budget left with the earliest deadline runs first,
+// ahead of the other classes. Client which used up its budget is
+// throttled until its next period, so that it cannot overrun
+// its reservation and delay the others.
+// Job is done when the client blocks, it misses the deadline if
+// the client is still runnable, or blocked, after the deadline.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
+#include "mlfq.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+
+// Start the job of the client at `start`, replenishing its budget.
+static void
+newjob(struct proc* p, uint64 start)
+{
+  p->mlfq.dlbudget = cycles(p->mlfq.dlruntime);
+  p->mlfq.dlabs = start + cycles(p->mlfq.dldeadline);
+  p->mlfq.dlnext = start + cycles(p->mlfq.dlperiod);
+  p->mlfq.dllate = 0;
+  p->mlfq.dljobs++;
+}
+
+// Count the miss of the current job once.
+static void
+miss(struct edf* this, struct proc* p)
+{
+  if (p->mlfq.dllate)
+    return;
+  p->mlfq.dllate = 1;
+  p->mlfq.dlmiss++;
+  this->nmiss++;
+}
+
+// Client throttled until its next period.
+static void
+throttle(struct edf* this, struct proc* p)
+{
+  if (this->release == 0 || p->mlfq.dlnext < this->release)
+    this->release = p->mlfq.dlnext;
+}
+
+void
+edf_init(struct edf* this)
+{
+  this->total = 0;
+  this->release = 0;
+  this->nmiss = 0;
+  this->queue.head = 0;
+  this->queue.tail = 0;
+}
+
+// Append process with given density, the proportion of its runtime
+// to its deadline, which is a sufficient bound of its utilization.
+// Density is shared with the other classes of `reserved` tickets.
+int
+edf_append(struct edf* this, uint reserved, struct proc* p, int usage)
+{
+  if (usage <= 0 || reserved + this->total + usage > MAXSTRIDE)
+    return 0;
+
+  this->total += usage;
+  p->mlfq.level = EDF_LEVEL;
+  p->mlfq.weight = usage;
+  p->mlfq.dljobs = 0;
+  p->mlfq.dlmiss = 0;
+  newjob(p, rdtsc());
+  return 1;
+}
+
+void
+edf_delete(struct edf* this, struct proc* p)
+{
+  this->total -= p->mlfq.weight;
+  p->mlfq.weight = 0;
+}
+
+void
+edf_push(struct edf* this, struct proc* p)
+{
+  runlist_append(&this->queue, p);
+}
+
+void
+edf_remove(struct edf* this, struct proc* p)
+{
+  runlist_remove(&this->queue, p);
+}
+
+// Client wakes up after its job was done.
+// Its budget is replenished for a new job, unless the budget left
+// fits its bandwidth until the current deadline, so that waking up
+// early cannot claim more than its reservation.
+void
+edf_wake(struct edf* this, struct proc* p)
+{
+  uint64 now = rdtsc();
+
+  if (p->mlfq.lastrun > p->mlfq.dlabs)
+    miss(this, p);
+  // Parameters in microseconds keep the products in 64-bit.
+  if (now >= p->mlfq.dlabs
+      || p->mlfq.dlbudget * p->mlfq.dldeadline
+         > (p->mlfq.dlabs - now) * p->mlfq.dlruntime)
+    newjob(p, now);
+}
+
+// Get client of the earliest deadline with budget left, or zero.
+// Runnable client passing its deadline misses it,
+// and the one passing its period starts the next job,
+// following the last period unless it fell behind a whole period.
+struct proc*
+edf_next(struct edf* this)
+{
+  struct proc* p;
+  struct proc* best = 0;
+  uint64 now = rdtsc();
+
+  this->release = 0;
+  for (p = this->queue.head; p; p = p->mlfq.next) {
+    if (now > p->mlfq.dlabs)
+      miss(this, p);
+    if (now >= p->mlfq.dlnext)
+      newjob(p, now - p->mlfq.dlnext < cycles(p->mlfq.dlperiod)
+                ? p->mlfq.dlnext : now);
+
+    if (p->mlfq.dlbudget == 0)
+      throttle(this, p);
+    else if (best == 0 || p->mlfq.dlabs < best->mlfq.dlabs)
+      best = p;
+  }
+  return best;
+}
+
+// Charge the client which consumed `used` cycles.
+// Client keeps the cpu while its budget lasts before its deadline.
+int
+edf_update(struct edf* this, struct proc* p, uint64 used)
+{
+  if (used < p->mlfq.dlbudget)
+    p->mlfq.dlbudget -= used;
+  else {
+    p->mlfq.dlbudget = 0;
+    throttle(this, p);
+  }
+  return p->mlfq.dlbudget && rdtsc() < p->mlfq.dlabs ? MLFQ_KEEP : MLFQ_NEXT;
+}
+
+// Cycles left in the budget of the running client.
+uint64
+edf_remain(struct edf* this, struct proc* p)
+{
+  uint64 used = rdtsc() - mycpu()->start;
+  return used < p->mlfq.dlbudget ? p->mlfq.dlbudget - used : 0;
+}
+
+// Cycles until the earliest throttled client is replenished,
+// bounded by `left`. It is read without the lock by the interrupt.
+uint64
+edf_until(struct edf* this, uint64 left)
+{
+  uint64 now;
+  uint64 release = this->release;
+
+  if (release == 0)
+    return left;
+  now = rdtsc();
+  if (release <= now)
+    return 0;
+  return release - now < left ? release - now : left;
+}
@@ -0,0 +1,126 @@
+/**
+ *  This program tests the EDF scheduler declared by set_deadline().
+ *  Every process is restricted to the first cpu, so that admission
+ * and competition do not depend on the number of cpus.
+ *  Reservations beyond the share are rejected, periodic client
+ * finishes its jobs by the deadlines while cpu bound processes run,
+ * and client running beyond its budget misses the deadlines.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+#define NHOG            2
+#define NPERIOD         20
+#define PERIOD          (100000 / TICKUS)   // 100 ms (ticks)
+#define RUNTIME         20000       // reserved per period (us)
+#define DEADLINE        50000       // from the start of period (us)
+#define WORK            1           // computation per period (ticks)
+
+// Run child which reports the result of its EDF reservation.
+void
+child(void (*test)(void))
+{
+  if (fork() == 0) {
+    test();
+    exit();
+  }
+  wait();
+}
+
+void
+admission(void)
+{
+  int pid;
+
+  if (set_deadline(0, 100000, 100000) == 0
+      || set_deadline(60000, 100000, 50000) == 0
+      || set_deadline(20000, 100000, 200000) == 0)
+    printf(1, "admission: invalid reservation accepted\n");
+
+  if (set_deadline(30000, 100000, 100000) != 0) {
+    printf(1, "admission: reservation failure\n");
+    return;
+  }
+  if (set_deadline(10000, 100000, 100000) == 0)
+    printf(1, "admission: reserved twice\n");
+
+  // Density 30% and 60% exceed the share of 80%.
+  if ((pid = fork()) == 0) {
+    if (set_deadline(30000, 100000, 50000) == 0)
+      printf(1, "admission: overbooked reservation accepted\n");
+    exit();
+  }
+  wait();
+  printf(1, "admission: done\n");
+}
+
+void
+periodic(void)
+{
+  int i;
+  uint start;
+  struct dlstat st;
+
+  if (set_deadline(RUNTIME, PERIOD * TICKUS, DEADLINE) != 0) {
+    printf(1, "periodic: reservation failure\n");
+    return;
+  }
+
+  start = uptime();
+  for (i = 1; i <= NPERIOD; ++i) {
+    work(WORK);
+    sleep(start + i * PERIOD - uptime());
+  }
+
+  getdeadline(&st);
+  printf(1, "periodic: jobs %d, misses %d%s\n", st.njob, st.nmiss,
+         st.nmiss ? " (expected 0)" : "");
+}
+
+void
+overrun(void)
+{
+  uint start;
+  struct dlstat st;
+
+  if (set_deadline(RUNTIME, PERIOD * TICKUS, DEADLINE) != 0) {
+    printf(1, "overrun: reservation failure\n");
+    return;
+  }
+
+  // Never done, every job misses its deadline.
+  start = uptime();
+  while (uptime() - start < NPERIOD * PERIOD)
+    ;
+
+  getdeadline(&st);
+  printf(1, "overrun: jobs %d, misses %d%s\n", st.njob, st.nmiss,
+         st.nmiss + 1 < st.njob ? " (expected every job)" : "");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat before, after;
+
+  if (sched_setaffinity(0, 1) != 0) {
+    printf(1, "sched_setaffinity failure\n");
+    exit();
+  }
+
+  child(admission);
+
+  hogs(NHOG);
+  getschedstat(&before);
+  child(periodic);
+  child(overrun);
+  getschedstat(&after);
+  killhogs(NHOG);
+
+  printf(1, "deadline misses: %d\n", after.nmiss - before.nmiss);
+  exit();
+}
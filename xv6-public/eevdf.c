@@ -0,0 +1,142 @@
+// Earliest eligible virtual deadline first scheduler.
+// Client reserves a proportion of cpu and requests a slice of cpu time.
+// Virtual time of a client advances by its service divided by its share,
+// and it is eligible while it does not run ahead of the real time.
+// Eligible client of the earliest deadline, the end of its request
+// in virtual time, runs first, so that client waking up with a short
+// request runs soon instead of waiting behind the others.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
+#include "mlfq.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+
+// Unit of virtual time, 2^VSHIFT cycles.
+#define VSHIFT 8
+
+// Current real time in the unit of virtual time.
+static uint64
+vnow(void)
+{
+  return rdtsc() >> VSHIFT;
+}
+
+// Virtual time of the service of `used` cycles to the client.
+// Divided in two steps for staying in 32-bit without libgcc.
+static uint64
+vtime(struct proc* p, uint64 used)
+{
+  uint n, w = p->mlfq.weight;
+
+  used >>= VSHIFT;
+  n = used >> 32 ? 0xFFFFFFFF : (uint)used;
+  return (uint64)(n / w) * MAXTICKET + n % w * MAXTICKET / w;
+}
+
+// Issue the next request of the client, starting at its eligible time.
+static void
+request(struct proc* p)
+{
+  p->mlfq.served = 0;
+  p->mlfq.vd = p->mlfq.ve + vtime(p, p->mlfq.request);
+}
+
+void
+eevdf_init(struct eevdf* this)
+{
+  this->total = 0;
+  this->queue.head = 0;
+  this->queue.tail = 0;
+}
+
+// Append process with given proportion and request of `slice` cycles.
+// Proportion is shared with the other classes of `reserved` tickets.
+int
+eevdf_append(struct eevdf* this, uint reserved,
+             struct proc* p, int usage, uint64 slice)
+{
+  if (usage <= 0 || slice == 0 || reserved + this->total + usage > MAXSTRIDE)
+    return 0;
+
+  this->total += usage;
+  p->mlfq.level = EEVDF_LEVEL;
+  p->mlfq.weight = usage;
+  p->mlfq.request = slice;
+  p->mlfq.ve = vnow();
+  request(p);
+  return 1;
+}
+
+void
+eevdf_delete(struct eevdf* this, struct proc* p)
+{
+  this->total -= p->mlfq.weight;
+  p->mlfq.weight = 0;
+}
+
+void
+eevdf_push(struct eevdf* this, struct proc* p)
+{
+  runlist_append(&this->queue, p);
+}
+
+void
+eevdf_remove(struct eevdf* this, struct proc* p)
+{
+  runlist_remove(&this->queue, p);
+}
+
+// Client wakes up after sleep.
+// It issues a new request from now, and cannot claim the time
+// passed while sleeping, but the time run ahead is kept.
+void
+eevdf_wake(struct eevdf* this, struct proc* p)
+{
+  uint64 now = vnow();
+  if (p->mlfq.ve < now)
+    p->mlfq.ve = now;
+  request(p);
+}
+
+// Get eligible client of the earliest deadline, or zero.
+struct proc*
+eevdf_next(struct eevdf* this)
+{
+  struct proc* p;
+  struct proc* best = 0;
+  uint64 now = vnow();
+
+  for (p = this->queue.head; p; p = p->mlfq.next)
+    if (p->mlfq.ve <= now && (best == 0 || p->mlfq.vd < best->mlfq.vd))
+      best = p;
+  return best;
+}
+
+// Update virtual time of the client which consumed `used` cycles.
+// Client keeps the cpu until its request completes,
+// unless it runs ahead of its proportion.
+int
+eevdf_update(struct eevdf* this, struct proc* p, uint64 used)
+{
+  p->mlfq.ve += vtime(p, used);
+  p->mlfq.served += used;
+  if (p->mlfq.served >= p->mlfq.request) {
+    request(p);
+    return MLFQ_NEXT;
+  }
+  return p->mlfq.ve <= vnow() ? MLFQ_KEEP : MLFQ_NEXT;
+}
+
+// Cycles left in the request of the running client.
+uint64
+eevdf_remain(struct eevdf* this, struct proc* p)
+{
+  uint64 served = p->mlfq.served + (rdtsc() - mycpu()->start);
+  return served < p->mlfq.request ? p->mlfq.request - served : 0;
+}
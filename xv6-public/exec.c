@@ -12,13 +12,15 @@ exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tls, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
   struct thread* t;
+  struct thread* next;
+  struct thread* curthread = mythread();
 
   begin_op();
 
@@ -38,6 +40,8 @@ exec(char *path, char **argv)
 
   if((pgdir = setupkvm()) == 0)
     goto bad;
+  if(mapclock(pgdir) < 0)
+    goto bad;
 
   // Load program into memory.
   sz = 0;
@@ -67,7 +71,15 @@ exec(char *path, char **argv)
   if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
-  sp = sz;
+
+  // Thread-local storage at the top of the stack,
+  // starting with thread ID and its base, see settls().
+  tls = sz - TLSSIZE;
+  ustack[0] = curthread->tid;
+  ustack[1] = tls;
+  if(copyout(pgdir, tls, ustack, 2*4) < 0)
+    goto bad;
+  sp = tls;
 
   // Push argument strings, prepare rest of stack in ustack.
   for(argc = 0; argv[argc]; argc++) {
@@ -88,6 +100,11 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
+  // Other threads may run on the other cpus,
+  // they must leave before the image is replaced.
+  if(killthreads() < 0)
+    goto bad;
+
   // Save program name for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
@@ -99,26 +116,22 @@ exec(char *path, char **argv)
   curproc->pgdir = pgdir;
   curproc->sz = sz;
 
-  for (t = curproc->threads; t < &curproc->threads[NTHREAD]; ++t) {
-    off = t - curproc->threads;
-    if (off == curproc->tidx) {
+  for (t = curproc->threads; t; t = next) {
+    next = t->pnext;
+    if (t == curthread) {
       // Update eip and esp of current thread.
       t->tf->eip = elf.entry;
       t->tf->esp = sp;
-      curproc->ustacks[off] = sz;
+      t->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+      t->ustack = sz;
+      t->tls = tls;
       continue;
     }
 
-    // Free other threads.
-    if (curproc->kstacks[off] != 0) {
-      kfree(curproc->kstacks[off]);
-      curproc->kstacks[off] = 0;
-      curproc->ustacks[off] = 0;
-    }
-
-    t->kstack = 0;
-    t->state = UNUSED;
-    t->tid = 0;
+    // Free other threads, after they are switched out.
+    if (t->state != UNUSED)
+      sched_offcpu(curproc, t);
+    thread_discard(t);
   }
 
   switchuvm(curproc);
@@ -0,0 +1,134 @@
+// Fair share scheduling policy.
+// Processes are ordered by virtual runtime, the cpu time consumed,
+// and the one consumed least runs next, so that every process
+// gets the same share of cpu regardless of its behavior.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
+#include "mlfq.h"
+#include "sched.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+
+static void
+fair_init(struct mlfq* this)
+{
+  this->vclock = 0;
+}
+
+static void
+fair_append(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.level = 0;
+  p->mlfq.vruntime = this->vclock;
+}
+
+// Insert process in the order of virtual runtime.
+// Process rejoining after sleep, or migrated from the other cpu,
+// starts from the clock of the run queue,
+// so that it cannot monopolize the cpu with the time left behind.
+static void
+fair_enqueue(struct mlfq* this, struct proc* p)
+{
+  struct proc* pos;
+
+  if (p->mlfq.vruntime < this->vclock)
+    p->mlfq.vruntime = this->vclock;
+
+  for (pos = this->queue[0].head; pos; pos = pos->mlfq.next)
+    if (p->mlfq.vruntime < pos->mlfq.vruntime)
+      break;
+
+  p->mlfq.queued = 1;
+  this->nqueued++;
+  runlist_insert(&this->queue[0], pos, p);
+}
+
+static void
+fair_dequeue(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.queued = 0;
+  this->nqueued--;
+  runlist_remove(&this->queue[0], p);
+}
+
+// Process of the least virtual runtime,
+// clock of the run queue follows it.
+static struct proc*
+fair_pick(struct mlfq* this, struct thread** t)
+{
+  struct proc* p;
+
+  while ((p = this->queue[0].head)) {
+    if (this->vclock < p->mlfq.vruntime)
+      this->vclock = p->mlfq.vruntime;
+    if ((*t = sched_thread(p)))
+      return p;
+    // Threads left runnable state without notifying scheduler.
+    fair_dequeue(this, p);
+  }
+  return 0;
+}
+
+// Give the process consumed most to the other cpu.
+static struct proc*
+fair_steal(struct mlfq* this, struct mlfq* thief)
+{
+  struct proc* p;
+
+  for (p = this->queue[0].tail; p; p = p->mlfq.prev)
+    if (sched_movable(this, thief, p)) {
+      fair_dequeue(this, p);
+      return p;
+    }
+  return 0;
+}
+
+static int
+fair_tick(struct mlfq* this, struct proc* p, struct thread* t, uint64 used)
+{
+  // When process terminated, queue is cleared by method wait().
+  if (p->state == ZOMBIE || p->killed)
+    return MLFQ_NEXT;
+
+  p->mlfq.vruntime += used;
+  // Other threads keep the process queued, restore the order.
+  if (p->mlfq.queued) {
+    fair_dequeue(this, p);
+    fair_enqueue(this, p);
+  }
+
+  // Quantum is shared by the threads dispatched in a row.
+  p->mlfq.slice += used;
+  if (p->mlfq.slice < cycles(this->quantum[0]))
+    return MLFQ_KEEP;
+
+  p->mlfq.slice = 0;
+  return MLFQ_NEXT;
+}
+
+static uint64
+fair_remain(struct mlfq* this, struct proc* p)
+{
+  uint64 dur = p->mlfq.slice + (rdtsc() - mycpu()->start);
+  uint64 quantum = cycles(this->quantum[0]);
+  return dur < quantum ? quantum - dur : 0;
+}
+
+struct schedops fair_ops = {
+  .name = "fair",
+  .init = fair_init,
+  .append = fair_append,
+  .enqueue = fair_enqueue,
+  .dequeue = fair_dequeue,
+  .pick_next = fair_pick,
+  .thread = sched_thread,
+  .steal = fair_steal,
+  .tick = fair_tick,
+  .remain = fair_remain,
+};
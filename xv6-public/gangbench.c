@@ -0,0 +1,108 @@
+/**
+ *  This program measures gang scheduling declared by set_gang().
+ *  Threads compute in phases separated by a spinning barrier,
+ * while cpu bound processes compete for every cpu.
+ *  Without the gang, a thread descheduled in a phase keeps the others
+ * spinning at the barrier until it runs again. With the gang, threads
+ * run in the same rounds across the cpus, so the elapsed ticks
+ * should decrease.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+#define NPHASE          200
+#define WORK            (1 << 16)   // iterations per phase
+#define MAXTHREAD       8
+
+int nthread;
+
+// Sense reversing barrier, threads spin without blocking.
+volatile uint arrived;
+volatile uint sense;
+
+void
+barrier(uint *local)
+{
+  *local = !*local;
+  if (__sync_add_and_fetch(&arrived, 1) == nthread) {
+    arrived = 0;
+    sense = *local;
+  } else
+    while (sense != *local)
+      ;
+}
+
+void*
+phases(void *arg)
+{
+  int i;
+  uint j;
+  uint local = 0;
+  volatile uint acc = 0;
+
+  for (i = 0; i < NPHASE; ++i) {
+    for (j = 0; j < WORK; ++j)
+      acc += j;
+    barrier(&local);
+  }
+
+  thread_exit((void*)acc);
+  return 0;
+}
+
+// Report elapsed ticks of the phases with the gang enabled or not.
+void
+bench(int gang, int nhog)
+{
+  int i;
+  uint start;
+  void *retval;
+  thread_t threads[MAXTHREAD];
+  struct schedstat before, after;
+
+  if (set_gang(gang) != 0) {
+    printf(1, "set_gang failure\n");
+    exit();
+  }
+
+  hogs(nhog);
+  getschedstat(&before);
+  start = uptime_fast();
+  arrived = 0;
+  sense = 0;
+  for (i = 0; i < nthread; ++i) {
+    if (thread_create(&threads[i], phases, 0) != 0) {
+      printf(1, "thread_create failure\n");
+      exit();
+    }
+  }
+  for (i = 0; i < nthread; ++i)
+    thread_join(threads[i], &retval);
+  start = uptime_fast() - start;
+  getschedstat(&after);
+  killhogs(nhog);
+
+  printf(1, "%s, hogs: %d, ticks: %d, followed: %d, ipis: %d\n",
+         gang ? "gang" : "no gang", nhog, start,
+         after.nfollow - before.nfollow, after.nipi - before.nipi);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat st;
+
+  getschedstat(&st);
+  nthread = st.ncpu < MAXTHREAD ? st.ncpu : MAXTHREAD;
+  printf(1, "threads: %d\n", nthread);
+
+  bench(0, 0);
+  bench(1, 0);
+  bench(0, st.ncpu);
+  bench(1, st.ncpu);
+  exit();
+}
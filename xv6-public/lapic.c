@@ -42,6 +42,18 @@
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
 volatile uint *lapic;  // Initialized in mp.c
+static uint tickcount;  // timer counts per tick, calibrated by the PIT
+
+// The 8253/8254 PIT channel 2, gated by the speaker port,
+// measures the time independent of the cpu.
+#define PIT_CH2     0x42
+#define PIT_MODE    0x43
+#define PIT_GATE    0x61
+  #define GATE2      0x01         // channel 2 counts while set
+  #define SPEAKER    0x02         // speaker output
+  #define OUT2       0x20         // channel 2 output reached zero
+#define PIT_HZ      1193182
+#define CALMS       10            // calibration period (milliseconds)
 
 //PAGEBREAK!
 static void
@@ -51,6 +63,36 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+// Count the timer and TSC while the PIT counts CALMS milliseconds.
+static void
+calibrate(void)
+{
+  uint count = PIT_HZ / (1000 / CALMS);
+  uint elapsed;
+  uint64 tsc;
+
+  // One-shot timer from the maximum, without interrupt.
+  lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+
+  // Mode 0, counting starts by loading the count,
+  // and the output rises when the count reaches zero.
+  outb(PIT_GATE, (inb(PIT_GATE) & ~SPEAKER) | GATE2);
+  outb(PIT_MODE, 0xB0);
+  outb(PIT_CH2, count & 0xFF);
+  outb(PIT_CH2, count >> 8);
+
+  lapicw(TICR, 0xFFFFFFFF);
+  tsc = rdtsc();
+  while((inb(PIT_GATE) & OUT2) == 0)
+    ;
+  tsc = rdtsc() - tsc;
+  elapsed = 0xFFFFFFFF - lapic[TCCR];
+  outb(PIT_GATE, inb(PIT_GATE) & ~GATE2);
+
+  tickcount = div64((uint64)elapsed * TICKUS, CALMS * 1000);
+  tickcycles = div64(tsc * TICKUS, CALMS * 1000);
+}
+
 void
 lapicinit(void)
 {
@@ -62,11 +104,13 @@ lapicinit(void)
 
   // The timer repeatedly counts down at bus frequency
   // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // TICR is calibrated against the PIT for HZ, once by the boot cpu,
+  // which is also the calibration of TSC.
   lapicw(TDCR, X1);
+  if(tickcount == 0)
+    calibrate();
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, tickcount);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,11 +157,48 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
-// Spin for a given number of microseconds.
-// On real hardware would want to tune this dynamically.
+// Send interrupt of given vector to the other cpu.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Arm the timer to interrupt once after `cycles` of TSC,
+// or stop it if zero.
+void
+lapictimer(uint64 cycles)
+{
+  uint64 max;
+
+  if(!lapic)
+    return;
+  if(cycles == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    return;
+  }
+
+  // Keep the count in 32-bit.
+  max = (uint64)(0xFFFFFFFF / tickcount - 1) * tickcycles;
+  if(cycles > max)
+    cycles = max;
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, div64(cycles * tickcount, tickcycles) + 1);
+}
+
+// Spin for a given number of microseconds, by calibrated TSC.
 void
 microdelay(int us)
 {
+  uint64 end = rdtsc() + cycles(us);
+
+  while(rdtsc() < end)
+    ;
 }
 
 #define CMOS_PORT    0x70
@@ -0,0 +1,104 @@
+/**
+ *  This program measures the wakeup latency of a server process
+ * while cpu bound processes keep every cpu busy.
+ *  Client writes the TSC to the pipe every tick, and the server
+ * blocked on the pipe measures the delay until it runs.
+ *  The server joins the stride scheduler first, and then the EEVDF
+ * scheduler with the same proportion.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+#include "x86.h"
+
+#define NHOG            4           // cpu bound processes
+#define NROUND          200         // wakeups measured
+#define SHARE           10          // (percent)
+#define SLICE           1000        // request of EEVDF client (us)
+
+void
+server(int rfd, int wfd)
+{
+  int i;
+  uint64 sent, lat, sum, max;
+
+  sum = max = 0;
+  for (i = 0; i < NROUND; ++i) {
+    if (read(rfd, &sent, sizeof(sent)) != sizeof(sent))
+      break;
+    lat = rdtsc() - sent;
+    sum += lat;
+    if (lat > max)
+      max = lat;
+  }
+  write(wfd, &sum, sizeof(sum));
+  write(wfd, &max, sizeof(max));
+}
+
+void
+bench(int eevdf)
+{
+  int i, pid, ok;
+  int ping[2], result[2];
+  uint64 tsc, sum, max;
+
+  if (pipe(ping) < 0 || pipe(result) < 0) {
+    printf(1, "pipe failure\n");
+    exit();
+  }
+
+  if ((pid = fork()) == 0) {
+    ok = eevdf ? set_latency(SHARE, SLICE) : set_cpu_share(SHARE);
+    if (ok < 0)
+      printf(1, "cannot join the scheduler\n");
+    close(ping[1]);
+    close(result[0]);
+    server(ping[0], result[1]);
+    exit();
+  }
+  close(ping[0]);
+  close(result[1]);
+
+  // Let the server join first.
+  sleep(10);
+  for (i = 0; i < NROUND; ++i) {
+    sleep(1);
+    tsc = rdtsc();
+    write(ping[1], &tsc, sizeof(tsc));
+  }
+  close(ping[1]);
+
+  sum = max = 0;
+  read(result[0], &sum, sizeof(sum));
+  read(result[0], &max, sizeof(max));
+  close(result[0]);
+  wait();
+
+  printf(1, "%s: avg %d us, max %d us\n", eevdf ? "eevdf" : "stride",
+         cycles2us(div64(sum, NROUND)), cycles2us(max));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  int hogs[NHOG];
+
+  for (i = 0; i < NHOG; ++i) {
+    if ((hogs[i] = fork()) == 0)
+      for (;;)
+        ;
+  }
+
+  bench(0);
+  bench(1);
+
+  for (i = 0; i < NHOG; ++i) {
+    kill(hogs[i]);
+    wait();
+  }
+  exit();
+}
@@ -0,0 +1,112 @@
+/**
+ *  This program measures the throughput of lock acquisitions with
+ * 1 to 16 threads contending for a lock, see usync.c.
+ *  Each thread takes the lock a fixed number of times, and the
+ * acquisitions per tick are compared between the mutex blocking on
+ * the futex, the spinlock, and the reader-writer lock taken by readers
+ * and by writers. Readers share the lock, so their throughput should
+ * grow with the threads, while the others are serialized.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+
+#define NITER           5000        // acquisitions per thread
+#define CS              50          // iterations in the critical section
+#define MAXTHREAD       16
+
+enum { MUTEX, SPIN, RDLOCK, WRLOCK, NKIND };
+
+static const char *names[NKIND] = { "mutex", "spin", "rdlock", "wrlock" };
+
+mutex_t mutex;
+rwlock_t rwlock;
+volatile uint spinlock;
+volatile uint counter;
+
+void
+run(int kind)
+{
+  int i, j;
+  volatile uint sum = 0;
+
+  for (i = 0; i < NITER; ++i) {
+    switch (kind) {
+    case MUTEX:
+      mutex_lock(&mutex);
+      for (j = 0; j < CS; ++j)
+        counter++;
+      mutex_unlock(&mutex);
+      break;
+    case SPIN:
+      while (atomic_xchg(&spinlock, 1))
+        ;
+      for (j = 0; j < CS; ++j)
+        counter++;
+      spinlock = 0;
+      break;
+    case RDLOCK:
+      rwlock_rdlock(&rwlock);
+      for (j = 0; j < CS; ++j)
+        sum += counter;
+      rwlock_unlock(&rwlock);
+      break;
+    case WRLOCK:
+      rwlock_wrlock(&rwlock);
+      for (j = 0; j < CS; ++j)
+        counter++;
+      rwlock_unlock(&rwlock);
+      break;
+    }
+  }
+}
+
+void*
+worker(void *arg)
+{
+  run((int)arg);
+  thread_exit(0);
+  return 0;
+}
+
+// Report acquisitions per tick with `n` threads, this one included.
+void
+bench(int kind, int n)
+{
+  int i, created;
+  uint ticks;
+  void *retval;
+  thread_t threads[MAXTHREAD];
+
+  counter = 0;
+  ticks = uptime_fast();
+  for (created = 0; created < n - 1; ++created)
+    if (thread_create(&threads[created], worker, (void*)kind) != 0)
+      break;
+  run(kind);
+  for (i = 0; i < created; ++i)
+    thread_join(threads[i], &retval);
+  ticks = uptime_fast() - ticks;
+
+  n = created + 1;
+  printf(1, "%s, threads: %d, ticks: %d, acquisitions/tick: %d",
+         names[kind], n, ticks, n * NITER / (ticks ? ticks : 1));
+  if (kind != RDLOCK && counter != n * NITER * CS)
+    printf(1, " (lost updates: %d)", n * NITER * CS - counter);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kind, n;
+
+  mutex_init(&mutex);
+  rwlock_init(&rwlock);
+  for (kind = 0; kind < NKIND; ++kind)
+    for (n = 1; n <= MAXTHREAD; n *= 2)
+      bench(kind, n);
+  exit();
+}
@@ -2,24 +2,250 @@
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
 #include "mlfq.h"
+#include "sched.h"
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
-#include "spinlock.h"
-
-extern int sys_uptime(void);
 
 static struct proc* MLFQ_PROC = (struct proc*)-1;
 
-// Check whether given process has runnable threads.
+// Limit of the charge for a single run, in stride quanta.
+#define MAXCHARGE 16
+
+// Limit of the lag behind the others, in strides of the client,
+// which a client rejoining after sleep may catch up.
+#define MAXCATCHUP 2
+
+// Limit of the period of EDF client, in microseconds.
+#define MAXPERIOD 10000000
+
+// Priority boost shared by all run queues.
+// Each cpu applies the boost to its own queue when it sees the epoch changed,
+// so that every process is boosted at the same tick regardless of cpu.
+static struct {
+  volatile uint epoch;        // number of priority boosts
+  volatile uint next;         // tick of the next boost
+  volatile uint period;       // microseconds between boosts
+} boost;
+
+// Boost period in ticks, at least one.
+static uint
+boostticks(void)
+{
+  uint n = boost.period / TICKUS;
+  return n ? n : 1;
+}
+
+// Compare pass values, wrapping around safely.
+static int
+passlt(uint64 a, uint64 b) {
+  return (long long)(a - b) < 0;
+}
+
+// Get MLFQ level of the thread,
+// applying the priority boost which was missed by the thread.
 static int
+tlevel(struct thread* t)
+{
+  uint epoch = boost.epoch;
+  if (t->mlfq.epoch != epoch) {
+    t->mlfq.epoch = epoch;
+    t->mlfq.level = 0;
+    t->mlfq.elapsed = 0;
+  }
+  return t->mlfq.level;
+}
+
+// Get the runnable thread in given process.
+// Threads holding a share of the process and the rest of threads
+// divide the process's cpu time by stride scheduling,
+// and the rest of threads are picked by their own MLFQ level.
+// Threads of the same level run in round robin order,
+// the one runnable longest first.
+// Thread still switching out from the other cpu is skipped.
+// It returns 0 if nothing runnable.
+static struct thread*
 runnable(struct proc* p) {
+  struct thread *t, *next;
+  struct thread *best = 0;
+  struct thread *share = 0;
+
+  for (t = p->rhead; t; t = next) {
+    next = t->rnext;
+    if (t->state != RUNNABLE) {
+      // Thread left runnable state without notifying scheduler.
+      sched_unlink(p, t);
+      continue;
+    }
+    if (t->oncpu)
+      continue;
+
+    if (t->mlfq.ticket) {
+      if (share == 0 || passlt(t->mlfq.pass, share->mlfq.pass))
+        share = t;
+    } else if (best == 0 || tlevel(t) < best->mlfq.level)
+      best = t;
+  }
+
+  if (share == 0)
+    return best;
+  if (best == 0) {
+    // Threads without share are idle,
+    // they cannot claim the time passed meanwhile.
+    if (passlt(p->mlfq.tpass, share->mlfq.pass))
+      p->mlfq.tpass = share->mlfq.pass;
+    return share;
+  }
+  return passlt(p->mlfq.tpass, share->mlfq.pass) ? best : share;
+}
+
+// Get the level of the best runnable thread,
+// which is the level the process is queued at.
+static int
+plevel(struct proc* p)
+{
   struct thread* t;
-  for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-    if (t->state == RUNNABLE)
-      return t - p->threads;
-  return -1;
+  int level = NMLFQ;
+
+  for (t = p->rhead; t; t = t->rnext)
+    if (t->state == RUNNABLE && tlevel(t) < level)
+      level = t->mlfq.level;
+  return level < NMLFQ ? level : p->mlfq.level;
+}
+
+// Pass increment of the client with given stride
+// which consumed `used` cycles in the quantum of given microseconds.
+// Pass advances by a stride per quantum, in proportion to the consumption.
+static uint
+charge(uint stride, uint us, uint64 used)
+{
+  uint64 quantum = cycles(us);
+  if (quantum == 0)
+    // TSC is not calibrated yet.
+    return stride;
+
+  if (used > quantum * MAXCHARGE)
+    used = quantum * MAXCHARGE;
+  // Keep the divisor in 32-bit.
+  while (quantum >> 32) {
+    quantum >>= 1;
+    used >>= 1;
+  }
+  return div64((uint64)stride * used, quantum);
+}
+
+// Place slot at the heap position.
+static void
+heapset(struct stride* this, int pos, int idx) {
+  this->heap[pos] = idx;
+  this->pos[idx] = pos;
+}
+
+// Move slot at the heap position toward the root.
+static void
+siftup(struct stride* this, int pos) {
+  int parent;
+  int idx = this->heap[pos];
+
+  while (pos > 0) {
+    parent = (pos - 1) / 2;
+    if (!passlt(this->pass[idx], this->pass[this->heap[parent]]))
+      break;
+    heapset(this, pos, this->heap[parent]);
+    pos = parent;
+  }
+  heapset(this, pos, idx);
+}
+
+// Move slot at the heap position toward the leaves.
+static void
+siftdown(struct stride* this, int pos) {
+  int child;
+  int idx = this->heap[pos];
+
+  while ((child = 2 * pos + 1) < this->nheap) {
+    if (child + 1 < this->nheap
+        && passlt(this->pass[this->heap[child + 1]],
+                  this->pass[this->heap[child]]))
+      child++;
+    if (!passlt(this->pass[this->heap[child]], this->pass[idx]))
+      break;
+    heapset(this, pos, this->heap[child]);
+    pos = child;
+  }
+  heapset(this, pos, idx);
+}
+
+// Insert runnable slot to the heap.
+// Client rejoining after sleep gets back a part of the share left unused,
+// it starts at most MAXCATCHUP strides behind the minimum pass,
+// so that it cannot monopolize the cpu with the pass left behind.
+static void
+stride_push(struct stride* this, int idx) {
+  uint64 floor;
+  if (this->pos[idx] != -1)
+    return;
+
+  if (this->nheap > 0) {
+    floor = this->pass[this->heap[0]] - (uint64)this->stride[idx] * MAXCATCHUP;
+    if (passlt(this->pass[idx], floor))
+      this->pass[idx] = floor;
+  }
+
+  heapset(this, this->nheap++, idx);
+  siftup(this, this->pos[idx]);
+}
+
+// Remove slot from the heap.
+static void
+stride_remove(struct stride* this, int idx) {
+  int last;
+  int pos = this->pos[idx];
+  if (pos == -1)
+    return;
+
+  this->pos[idx] = -1;
+  if (pos == --this->nheap)
+    return;
+
+  // Fill the hole with the last one and restore heap order.
+  last = this->heap[this->nheap];
+  heapset(this, pos, last);
+  siftup(this, pos);
+  siftdown(this, this->pos[last]);
+}
+
+// Set tickets of the slot.
+static void
+stride_ticket(struct stride* this, int idx, uint ticket) {
+  this->ticket[idx] = ticket;
+  this->stride[idx] = ticket ? (MAXTICKET << PASSSHIFT) / ticket : 0;
+}
+
+// Tickets of the MLFQ scheduler, the rest of the reserved tickets.
+// When sleeping clients are overbooked, MLFQ keeps the minimum
+// and every client runs short of its reservation in proportion.
+static void
+stride_rebalance(struct stride* this) {
+  uint reserved = this->total < MAXSTRIDE ? this->total : MAXSTRIDE;
+  stride_ticket(this, 0, MAXTICKET - reserved);
+}
+
+// Tickets of the clients which are runnable or running.
+// Tickets of sleeping clients are available to the others.
+static uint
+stride_active(struct stride* this) {
+  int i;
+  uint active = 0;
+  struct proc* p;
+
+  for (i = 1; i < NPROC; ++i)
+    if ((p = this->queue[i]) && (p->mlfq.queued || p->mlfq.running))
+      active += this->ticket[i];
+  return active;
 }
 
 // Initialize stride scheduler.
@@ -32,29 +258,33 @@ void
 stride_init(struct stride* this) {
   int i;
   // Initialize MLFQ scheduler
-  this->quantum = 5;
+  this->quantum = 50000;
   this->total = 0;
   this->pass[0] = 0;
-  this->ticket[0] = MAXTICKET;
+  stride_ticket(this, 0, MAXTICKET);
   this->queue[0] = MLFQ_PROC;
 
   // Make queue empty except MLFQ scheduler.
   for (i = 1; i < NPROC; ++i) {
-    this->pass[i] = -1;
-    this->ticket[i] = 0;
+    this->pass[i] = 0;
+    stride_ticket(this, i, 0);
     this->queue[i] = 0;
+    this->pos[i] = -1;
   }
+
+  // MLFQ scheduler always stays in the heap.
+  this->nheap = 0;
+  this->pos[0] = -1;
+  stride_push(this, 0);
 }
 
-// Append process to the stride scheduler with given proportion of cpu usage.
+// Append process to the stride scheduler with given tickets.
+// Process joins the heap when it is queued.
 int
 stride_append(struct stride* this, struct proc* p, int usage) {
   int idx;
-  float minpass;
-  float* pass;
   struct proc** iter;
-  // If total proprotion exceeds maximum stride scheduling.
-  if (this->total + usage > MAXSTRIDE || usage <= 0)
+  if (usage <= 0)
     return 0;
 
   // Find empty space.
@@ -72,19 +302,12 @@ found:
 
   *iter = p;
   this->total += usage;
-  this->ticket[0] -= usage;
-  this->ticket[idx] = usage;
+  stride_rebalance(this);
+  stride_ticket(this, idx, usage);
 
   // Set pass value of given process
   // with minimum pass value between existing processes.
-  minpass = this->pass[0];
-  for (pass = this->pass + 1; pass != &this->pass[NPROC]; ++pass) {
-    if (*pass != -1 && minpass > *pass) {
-      minpass = *pass;
-    }
-  }
-
-  this->pass[idx] = minpass;
+  this->pass[idx] = this->pass[this->heap[0]];
   return 1;
 }
 
@@ -92,193 +315,478 @@ found:
 void
 stride_delete(struct stride* this, struct proc* p) {
   int idx = p->mlfq.index;
-  int usage = this->ticket[idx];
-  this->total -= usage;
-  this->ticket[0] += usage;
+  this->total -= this->ticket[idx];
+  stride_rebalance(this);
 
-  this->pass[idx] = -1;
-  this->ticket[idx] = 0;
+  stride_remove(this, idx);
+  stride_ticket(this, idx, 0);
   this->queue[idx] = 0;
 }
 
-// Update pass value of given process.
+// Update pass value of given process which consumed `used` cycles.
 int
-stride_update(struct stride* this, struct proc* p) {
+stride_update(struct stride* this, struct proc* p, uint64 used) {
   int idx;
-  float* pass;
   if (p == MLFQ_PROC)
     idx = 0;
   else
     idx = p->mlfq.index;
 
-  this->pass[idx] += (float)MAXTICKET / this->ticket[idx];
-
-  // If pass value exceeds maximum pass value,
-  // substract all pass value with predefined scaling term
-  // to maintain them in sufficient range.
-  if (this->pass[idx] > MAXPASS)
-    for (pass = this->pass; pass != this->pass + NPROC; ++pass)
-      if (*pass > 0)
-        *pass -= MAXPASS - SCALEPASS;
+  this->pass[idx] += charge(this->stride[idx], this->quantum, used);
+  if (this->pos[idx] != -1)
+    siftdown(this, this->pos[idx]);
 
   return MLFQ_NEXT;
 }
 
 // Get next process based on stride scheduling policy.
-// Write runnable thread index if exists.
+// It returns MLFQ_PROC when MLFQ scheduler has the minimum pass.
 struct proc*
-stride_next(struct stride* this, int* tidx) {
-  int idx;
-  float* iter;
-  float* minpass = this->pass;
-
-  // Get process which is runnable and have minimum pass value.
-  for (iter = this->pass + 1; iter != &this->pass[NPROC]; ++iter)
-    if (*iter != -1 && *minpass > *iter)
-      if ((idx = runnable(this->queue[iter - this->pass])) != -1) {
-        minpass = iter;
-        *tidx = idx;
-      }
+stride_next(struct stride* this) {
+  return this->queue[this->heap[0]];
+}
 
-  return this->queue[minpass - this->pass];
+// Get process of the minimum pass below MLFQ scheduler
+// at the top of the heap, 0 if none.
+static struct proc*
+stride_after(struct stride* this) {
+  int i = 1;
+
+  if (this->nheap < 2)
+    return 0;
+  if (this->nheap > 2
+      && passlt(this->pass[this->heap[2]], this->pass[this->heap[1]]))
+    i = 2;
+  return this->queue[this->heap[i]];
 }
 
-// Initialize MLFQ scheduler. 
-void
-mlfq_init(struct mlfq* this)
+// Link process at the tail of the run queue of its level.
+// Stride process is pushed to the heap of stride scheduler,
+// and EEVDF or EDF client to its queue instead.
+static void
+enqueue(struct mlfq* this, struct proc* p)
 {
-  int i, j;
-  struct proc** iter = &this->queue[0][0];
+  struct runlist* q;
 
-  static const uint quantum[] = { 5, 10, 20 };
-  static const uint expire[] = { 20, 40, 200 };
+  p->mlfq.queued = 1;
+  this->nqueued++;
+  if (p->mlfq.level == STRIDE_LEVEL) {
+    stride_push(&this->metasched, p->mlfq.index);
+    return;
+  }
+  if (p->mlfq.level == EEVDF_LEVEL) {
+    eevdf_push(&this->latency, p);
+    return;
+  }
+  if (p->mlfq.level == EDF_LEVEL) {
+    edf_push(&this->realtime, p);
+    return;
+  }
 
-  for (i = 0; i < NMLFQ; ++i) {
-    this->quantum[i] = quantum[i];
-    this->expire[i] = expire[i];
-    for (j = 0; j < NPROC; ++j, ++iter)
-      *iter = 0;
+  p->mlfq.level = plevel(p);
+  q = &this->queue[p->mlfq.level];
+  runlist_append(q, p);
+  this->bitmap |= 1 << p->mlfq.level;
+}
 
-    this->iterstate[i] = this->queue[i];
+// Unlink process from the run queue of its level.
+static void
+dequeue(struct mlfq* this, struct proc* p)
+{
+  struct runlist* q;
+
+  p->mlfq.queued = 0;
+  this->nqueued--;
+  if (p->mlfq.level == STRIDE_LEVEL) {
+    stride_remove(&this->metasched, p->mlfq.index);
+    return;
+  }
+  if (p->mlfq.level == EEVDF_LEVEL) {
+    eevdf_remove(&this->latency, p);
+    return;
+  }
+  if (p->mlfq.level == EDF_LEVEL) {
+    edf_remove(&this->realtime, p);
+    return;
   }
 
+  q = &this->queue[p->mlfq.level];
+  runlist_remove(q, p);
+  if (q->head == 0)
+    this->bitmap &= ~(1 << p->mlfq.level);
+}
+
+// Initialize MLFQ scheduler of the run queue.
+static void
+mlfq_init(struct mlfq* this)
+{
+  this->epoch = 0;
+
+  boost.epoch = 0;
+  boost.period = this->expire[NMLFQ - 1];
+  boost.next = boostticks();
+
   // Stride scehduler acts as meta-scheduler,
   // which controls the cpu usage between MLFQ scheduling process
   // and stride scheduling process.
   stride_init(&this->metasched);
+  eevdf_init(&this->latency);
+  edf_init(&this->realtime);
 }
 
-// Append process to MLFQ scheduler.
-int
-mlfq_append(struct mlfq* this, struct proc* p, int level)
+// Copy scheduler parameters.
+void
+mlfq_getparam(struct mlfq* this, struct schedparam* param)
 {
-  struct proc** iter;
-  // Find empty space.
-  for (iter = this->queue[level]; iter != &this->queue[level][NPROC]; ++iter)
-    if (*iter == 0)
-      goto found;
-
-  return MLFQ_FULL_QUEUE;
+  int i;
 
-found:
-  *iter = p;
-  // Update scheduler information of given process.
-  p->mlfq.level = level;
-  p->mlfq.index = iter - this->queue[level];
-  p->mlfq.elapsed = 0;
-  return MLFQ_SUCCESS;
+  param->boost = boost.period;
+  for (i = 0; i < NMLFQ; ++i) {
+    param->quantum[i] = this->quantum[i];
+    param->expire[i] = this->expire[i];
+  }
 }
 
-// Pass process to the stride scheduler.
+// Replace scheduler parameters, which apply from the next decision.
+// Boost period is shared by all run queues,
+// the next boost is rescheduled by the new period.
 int
-mlfq_cpu_share(struct mlfq* this, struct proc* p, int usage)
+mlfq_setparam(struct mlfq* this, struct schedparam* param)
 {
-  int level = p->mlfq.level;
-  int index = p->mlfq.index;
-  if (!stride_append(&this->metasched, p, usage)) {
+  int i;
+
+  if (param->boost == 0)
     return -1;
+  for (i = 0; i < NMLFQ; ++i)
+    if (param->quantum[i] == 0 || param->expire[i] == 0)
+      return -1;
+
+  for (i = 0; i < NMLFQ; ++i) {
+    this->quantum[i] = param->quantum[i];
+    this->expire[i] = param->expire[i];
   }
-  // Remove from MLFQ scheduler.
-  this->queue[level][index] = 0;
+  boost.period = param->boost;
+  boost.next = readticks() + boostticks();
   return 0;
 }
 
-// Delete process from MLFQ scheduler.
+// Append new process to the top level of MLFQ scheduler.
+static void
+mlfq_append(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.level = 0;
+  p->mlfq.tshare = 0;
+  p->mlfq.tpass = 0;
+  p->mlfq.weight = 0;
+}
+
+// Initialize scheduler information of the new thread.
 void
-mlfq_delete(struct mlfq* this, struct proc* p)
+mlfq_thread_init(struct thread* t)
+{
+  t->mlfq.level = 0;
+  t->mlfq.elapsed = 0;
+  t->mlfq.epoch = boost.epoch;
+  t->mlfq.ticket = 0;
+  t->mlfq.pass = 0;
+}
+
+// Thread of given process became runnable.
+static void
+mlfq_wake(struct mlfq* this, struct proc* p, struct thread* t)
+{
+  struct proc* cur;
+
+  if (p->mlfq.level == EDF_LEVEL && !p->mlfq.queued && !p->mlfq.running) {
+    edf_wake(&this->realtime, p);
+    // Preempt the running process unless it has earlier deadline.
+    cur = this->cpu->proc;
+    if (cur && cur != p && (cur->mlfq.level != EDF_LEVEL
+                            || p->mlfq.dlabs < cur->mlfq.dlabs))
+      sched_preempt(this);
+  }
+
+  if (p->mlfq.level == EEVDF_LEVEL && !p->mlfq.queued && !p->mlfq.running) {
+    eevdf_wake(&this->latency, p);
+    // Preempt the running process unless it has earlier deadline,
+    // or it is EDF client.
+    cur = this->cpu->proc;
+    if (cur && cur != p && (cur->mlfq.level > EEVDF_LEVEL
+                            || (cur->mlfq.level == EEVDF_LEVEL
+                                && p->mlfq.vd < cur->mlfq.vd)))
+      sched_preempt(this);
+  }
+
+  // Thread rejoining after sleep starts from the pass of the others.
+  if (t->mlfq.ticket && passlt(t->mlfq.pass, p->mlfq.tpass))
+    t->mlfq.pass = p->mlfq.tpass;
+
+  if (p->mlfq.queued && p->mlfq.level > 0 && tlevel(t) < p->mlfq.level) {
+    // Thread of the higher level brings the process up.
+    dequeue(this, p);
+    enqueue(this, p);
+  }
+}
+
+// Join the stride scheduler with given tickets.
+// Tickets of sleeping stride clients may be reserved again,
+// up to the whole cpu, while EEVDF and EDF clients keep their reservation.
+static int
+stride_join(struct mlfq* this, struct proc* p, int usage, uint64 slice)
+{
+  struct stride* stride = &this->metasched;
+  uint other = this->latency.total + this->realtime.total;
+
+  if (usage <= 0 || other + stride->total + usage > MAXTICKET
+      || other + stride_active(stride) + usage > MAXSTRIDE)
+    return 0;
+  return stride_append(stride, p, usage);
+}
+
+// Join the EEVDF scheduler with given proportion and request.
+static int
+eevdf_join(struct mlfq* this, struct proc* p, int usage, uint64 slice)
+{
+  return eevdf_append(&this->latency,
+                      this->metasched.total + this->realtime.total,
+                      p, usage, slice);
+}
+
+// Join the EDF scheduler with given density.
+static int
+edf_join(struct mlfq* this, struct proc* p, int usage, uint64 slice)
+{
+  return edf_append(&this->realtime,
+                    this->metasched.total + this->latency.total, p, usage);
+}
+
+// Move MLFQ process to the other scheduling class by `join`.
+// Proportion is reserved on a single cpu, so it tries the run queue
+// holding the process first, and then the others.
+static int
+admit(struct proc* p, int (*join)(struct mlfq*, struct proc*, int, uint64),
+      int usage, uint64 slice)
+{
+  int i, ok, queued;
+  struct mlfq* home;
+  struct mlfq* target;
+
+  ok = 0;
+  for (i = -1; i < ncpu && !ok; ++i) {
+    home = sched_lock(p);
+    // Process already belongs to the other class.
+    if (p->mlfq.level < 0) {
+      release(&home->lock);
+      return -1;
+    }
+
+    target = i < 0 ? home : cpus[i].rq;
+    if (i >= 0 && (target == home || !(p->mlfq.cpus & CPUBIT(target)))) {
+      release(&home->lock);
+      continue;
+    }
+
+    if (target != home) {
+      release(&home->lock);
+      sched_lock2(home, target);
+      // Process may be stolen meanwhile, try again.
+      if (p->mlfq.rq != home) {
+        release(&target->lock);
+        release(&home->lock);
+        --i;
+        continue;
+      }
+    }
+
+    // Remove from MLFQ scheduler.
+    if ((queued = p->mlfq.queued))
+      dequeue(home, p);
+
+    if ((ok = join(target, p, usage, slice))) {
+      // Process stays on the cpu reserving its share.
+      if (target != home)
+        target->stat.nmigrate++;
+      p->mlfq.rq = target;
+      p->mlfq.slice = 0;
+    }
+    if (queued)
+      enqueue(p->mlfq.rq, p);
+
+    if (target != home)
+      release(&target->lock);
+    release(&home->lock);
+  }
+  return ok ? 0 : -1;
+}
+
+// Pass process to the stride scheduler.
+int
+mlfq_cpu_share(struct proc* p, int usage)
+{
+  return admit(p, stride_join, usage, 0);
+}
+
+// Pass process to the EEVDF scheduler, it requests `slice` microseconds
+// of cpu at once, up to 100 milliseconds.
+int
+mlfq_latency(struct proc* p, int usage, int slice)
+{
+  if (slice <= 0 || slice > 100000)
+    return -1;
+  return admit(p, eevdf_join, usage, cycles(slice));
+}
+
+// Pass process to the EDF scheduler, which reserves `runtime` microseconds
+// in every `period`, to be served within `deadline` from the period start.
+// Admission counts the density, runtime over deadline, against the share.
+int
+mlfq_deadline(struct proc* p, int runtime, int period, int deadline)
+{
+  if (runtime <= 0 || runtime > deadline || deadline > period
+      || period > MAXPERIOD || p->mlfq.level < 0)
+    return -1;
+
+  // Parameters are used after the process joins the class.
+  p->mlfq.dlruntime = runtime;
+  p->mlfq.dlperiod = period;
+  p->mlfq.dldeadline = deadline;
+  return admit(p, edf_join,
+               div64((uint64)runtime * MAXTICKET + deadline - 1, deadline), 0);
+}
+
+// Release the share of the exiting process.
+static void
+mlfq_remove(struct mlfq* this, struct proc* p)
 {
   // If process level is set to -1,
   // it indicates that process is scheduled by stride scheduler.
-  if (p->mlfq.level == -1)
+  if (p->mlfq.level == STRIDE_LEVEL)
     stride_delete(&this->metasched, p);
-  else
-    this->queue[p->mlfq.level][p->mlfq.index] = 0;  
+  else if (p->mlfq.level == EEVDF_LEVEL)
+    eevdf_delete(&this->latency, p);
+  else if (p->mlfq.level == EDF_LEVEL)
+    edf_delete(&this->realtime, p);
 }
 
-// Update process level by checking elapsed time.
+// Get MLFQ level of given process,
+// which is the level of its best thread.
 int
-mlfq_update(struct mlfq* this, struct proc* p, uint ctime)
+mlfq_level(struct mlfq* this, struct proc* p)
 {
-  int level = p->mlfq.level;
-  int index = p->mlfq.index;
+  int level = NMLFQ - 1;
+  struct thread* t;
+
+  if (p->mlfq.level < 0)
+    return p->mlfq.level;
+
+  for (t = p->threads; t; t = t->pnext)
+    if (t->state != UNUSED && t->state != ZOMBIE && tlevel(t) < level)
+      level = t->mlfq.level;
+  return level;
+}
+
+// Get MLFQ level of given thread.
+int
+mlfq_thread_level(struct mlfq* this, struct thread* t)
+{
+  return tlevel(t);
+}
+
+// Reserve proportion of the process's cpu time for given thread,
+// zero releases the reservation.
+// Threads without share divide the rest by their MLFQ level.
+int
+mlfq_thread_share(struct proc* p, struct thread* t, int usage)
+{
+  int ok;
+  struct mlfq* rq = sched_lock(p);
+
+  ok = usage >= 0 && p->mlfq.tshare - t->mlfq.ticket + usage <= MAXSTRIDE;
+  if (ok) {
+    p->mlfq.tshare += usage - t->mlfq.ticket;
+    t->mlfq.ticket = usage;
+    t->mlfq.pass = p->mlfq.tpass;
+  }
+  release(&rq->lock);
+  return ok ? 0 : -1;
+}
+
+// Update levels by checking elapsed time.
+// Thread `t` of the process consumed `used` cycles since it was dispatched.
+static int
+mlfq_update(struct mlfq* this, struct proc* p, struct thread* t, uint64 used)
+{
+  int level, demoted;
+  uint ticket;
 
   // When process terminated, queue is cleared by method wait().
   if (p->state == ZOMBIE || p->killed)
     return MLFQ_NEXT;
 
+  // Charge the thread holding a share, or the rest of threads.
+  if (p->mlfq.tshare) {
+    if ((ticket = t->mlfq.ticket))
+      t->mlfq.pass += charge((MAXTICKET << PASSSHIFT) / ticket,
+                             this->metasched.quantum, used);
+    else
+      p->mlfq.tpass += charge((MAXTICKET << PASSSHIFT)
+                              / (MAXTICKET - p->mlfq.tshare),
+                              this->metasched.quantum, used);
+  }
+
+  // Thread is demoted by its own cpu time, so that cpu bound thread
+  // does not drag the other threads of the process down.
+  // Thread may miss the boost while running.
+  level = tlevel(t);
+  t->mlfq.elapsed += used;
+  demoted = level + 1 < NMLFQ
+            && t->mlfq.elapsed >= cycles(this->expire[level]);
+  if (demoted) {
+    t->mlfq.level = level + 1;
+    t->mlfq.elapsed = 0;
+    t->mlfq.epoch = boost.epoch;
+    TRACE(TR_DEMOTE, p, t);
+  }
+
   // If process level is -1, it indicates scheduled by stride scheduler.
-  if (level == -1)
-    return stride_update(&this->metasched, p);
+  if (p->mlfq.level == STRIDE_LEVEL)
+    return stride_update(&this->metasched, p, used);
+  if (p->mlfq.level == EEVDF_LEVEL)
+    return eevdf_update(&this->latency, p, used);
+  if (p->mlfq.level == EDF_LEVEL)
+    return edf_update(&this->realtime, p, used);
+
+  // Quantum is shared by the threads dispatched in a row.
+  p->mlfq.slice += used;
 
   // Update pass value of MLFQ scheulder.
-  stride_update(&this->metasched, MLFQ_PROC);
-  // If avilable time is expired, move the process to the next queue.
-  if (level + 1 < NMLFQ && p->mlfq.elapsed >= this->expire[level]) {
-    if (mlfq_append(this, p, level + 1) != MLFQ_SUCCESS)
-      panic("mlfq: level elevation failed");
-
-    // Remove from current level queue.
-    this->queue[level][index] = 0;
-    return MLFQ_NEXT;
-  }
+  stride_update(&this->metasched, MLFQ_PROC, used);
 
+  // Demoted thread gives up the quantum, process returns to the queue
+  // at the level of its best thread.
   // Check process use CPU time of RR time quantum.
-  if (ctime - p->mlfq.start < this->quantum[level])
+  if (!demoted && p->mlfq.slice < cycles(this->quantum[level]))
     return MLFQ_KEEP;
-  else
-    return MLFQ_NEXT;
+
+  p->mlfq.slice = 0;
+  return MLFQ_NEXT;
 }
 
 // Get next process with MLFQ scheduling policy.
 // If it returns zero, it means nothing runnaable.
-// Write runnable thread index to given argument `tidx`.
-struct proc*
-mlfq_next(struct mlfq* this, int* tidx)
+// Write runnable thread to given argument `t`.
+static struct proc*
+mlfq_next(struct mlfq* this, struct thread** t)
 {
-  int i, flag, idx;
-  struct proc** iter;
   struct proc* p;
 
-  for (i = 0; i < NMLFQ; ++i) {
-    // Use flag for enabling all sequence check.
-    flag = 1;
-    for (iter = this->iterstate[i] + 1;
-         flag || iter != this->iterstate[i] + 1;
-         ++iter) {
-      flag = 0;
-      // If exceed the range, begin from first.
-      if (iter == &this->queue[i][NPROC])
-        iter = this->queue[i];
-      // Just runnable process.
-      p = *iter;
-      if (p == 0 || (idx = runnable(p)) == -1)
-        continue;
-      
-      // Update iterator state and return process.
-      this->iterstate[i] = iter;
-      *tidx = idx;
+  // Head of the highest non-empty level.
+  while (this->bitmap) {
+    p = this->queue[bsf(this->bitmap)].head;
+    dequeue(this, p);
+
+    if ((*t = runnable(p)))
       return p;
-    }
   }
 
   // Nothing to runnable.
@@ -286,112 +794,138 @@ mlfq_next(struct mlfq* this, int* tidx)
 }
 
 // Boost all process to the top level.
-void
+// Queued processes are spliced to the top level queue,
+// and threads are boosted lazily by the epoch.
+static void
 mlfq_boost(struct mlfq* this)
 {
-  int found;
+  int i;
   struct proc* p;
-  struct proc** top = this->queue[0];
-  struct proc** lower = this->queue[1];
-
-  for (; lower != &this->queue[NMLFQ - 1][NPROC]; ++lower) {
-    if (*lower == 0)
+  struct runlist* top = &this->queue[0];
+  struct runlist* lower;
+
+  this->epoch = boost.epoch;
+  TRACE(TR_BOOST, 0, 0);
+  for (i = 1; i < NMLFQ; ++i) {
+    lower = &this->queue[i];
+    if (lower->head == 0)
       continue;
 
-    found = 0;
-    // Find empty space on top level.
-    for (; top != &this->queue[0][NPROC]; ++top) {
-      if (*top != 0)
-        continue;
-      
-      // Move lower proceee to the top level.
-      *top = *lower;
-      *lower = 0;
-      // Update scheduler information.
-      p = *top;
+    // Update scheduler information.
+    for (p = lower->head; p; p = p->mlfq.next)
       p->mlfq.level = 0;
-      p->mlfq.index = top - this->queue[0];
-      p->mlfq.elapsed = 0;
 
-      found = 1;
-      break;
-    }
+    // Move lower queue to the tail of top level.
+    if (top->tail) {
+      top->tail->mlfq.next = lower->head;
+      lower->head->mlfq.prev = top->tail;
+    } else
+      top->head = lower->head;
+    top->tail = lower->tail;
 
-    if (!found)
-      panic("mlfq boost: could not find empty space of toplevel queue");
+    lower->head = 0;
+    lower->tail = 0;
   }
+
+  this->bitmap = top->head ? 1 : 0;
 }
 
-// MLFQ scheduler.
-void
-mlfq_scheduler(struct mlfq* this, struct spinlock* lock)
+// Advance the global boost epoch if boosting time arrived,
+// and apply it to this run queue.
+static void
+mlfq_sync(struct mlfq* this, uint ctime)
 {
-  int keep, idx;
-  uint start, end, boost, boostunit;
-  struct proc* p = 0;
-  struct cpu* c = mycpu();
+  uint next = boost.next;
+  if (ctime > next
+      && __sync_bool_compare_and_swap(&boost.next, next,
+                                      next + boostticks()))
+    __sync_fetch_and_add(&boost.epoch, 1);
+
+  if (this->epoch != boost.epoch)
+    mlfq_boost(this);
+}
+
+// Get next process, stride scheduler decides between
+// the stride processes and MLFQ scheduler.
+static struct proc*
+mlfq_pick(struct mlfq* this, struct thread** t)
+{
+  struct proc* p;
   struct stride* state = &this->metasched;
 
-  idx = 0;
-  c->proc = 0;
-  boostunit = this->expire[NMLFQ - 1];
+  mlfq_sync(this, readticks());
+  this->preempt = 0;
 
-  keep = MLFQ_NEXT;
-  boost = boostunit;
+  // EDF client of the earliest deadline comes first.
+  while ((p = edf_next(&this->realtime))) {
+    if ((*t = runnable(p)))
+      return p;
+    dequeue(this, p);
+  }
+  // Throttled clients get their budget back.
+  if (this->realtime.release)
+    sched_retry(this, edf_until(&this->realtime, ~0ULL));
+
+  // Eligible EEVDF client of the earliest deadline comes next.
+  while ((p = eevdf_next(&this->latency))) {
+    if ((*t = runnable(p)))
+      return p;
+    dequeue(this, p);
+  }
+
+  // Process which have minimum pass value.
+  while ((p = stride_next(state)) != MLFQ_PROC) {
+    if ((*t = runnable(p)))
+      return p;
+    // Threads left runnable state without notifying scheduler.
+    dequeue(this, p);
+  }
+
+  // If given process is MLFQ scheduler, request a new process.
+  if ((p = mlfq_next(this, t)) != 0)
+    return p;
+  // Update MLFQ pass value for preventing deadlock.
+  stride_update(state, MLFQ_PROC, cycles(state->quantum));
+
+  // Queued stride process runs while MLFQ queues are empty,
+  // the cpu must not halt until the retry with it runnable.
   for (;;) {
-    // Enable interrupts.
-    sti();
-
-    acquire(lock);
-    do {
-      // If previous run commands replace the proc or
-      // current process is not runnable.
-      if (keep == MLFQ_NEXT || p->threads[p->tidx].state != RUNNABLE) {
-        // Get next process from method to run.
-        p = stride_next(state, &idx);
-        // If given process is MLFQ scheduler,
-        // request a new process.
-        if (p == MLFQ_PROC)
-          p = mlfq_next(this, &idx);
-
-        // If there is nothing runnable.
-        if (p == 0) {
-          // Update MLFQ pass value for preventing deadlock.
-          keep = stride_update(state, MLFQ_PROC);
-          break;
-        }
-
-        // Update index of the current running thread.
-        p->tidx = idx;
-      }
+    if ((p = stride_next(state)) == MLFQ_PROC && (p = stride_after(state)) == 0)
+      return 0;
+    if ((*t = runnable(p)))
+      return p;
+    dequeue(this, p);
+  }
+}
 
-      // Switch to chosen process.
-      // It is the process's job to relase ptable.lock
-      // and then reacquire it before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->threads[p->tidx].state = RUNNING;
-
-      start = sys_uptime();
-      p->mlfq.start = start;
-      swtch(&(c->scheduler), p->threads[p->tidx].context);
-      switchkvm();
-
-      // Update MLFQ states.
-      end = sys_uptime();
-      p->mlfq.elapsed += end - start;
-      keep = mlfq_update(this, p, end);
-
-      // If boosting time arrived.
-      if (end > boost) {
-        mlfq_boost(this);
-        boost += boostunit;
-      }
+// Charge the run of the thread.
+static int
+mlfq_tick(struct mlfq* this, struct proc* p, struct thread* t, uint64 used)
+{
+  mlfq_sync(this, readticks());
+  return mlfq_update(this, p, t, used);
+}
+
+// Give a queued MLFQ process to the other idle cpu,
+// the one waiting longest at the highest level.
+// Stride process stays on the cpu reserving its share.
+static struct proc*
+mlfq_steal(struct mlfq* this, struct mlfq* thief)
+{
+  uint level;
+  uint mask = this->bitmap;
+  struct proc* p;
 
-      c->proc = 0;
-    } while (0);
-    release(lock);
+  while (mask) {
+    level = bsf(mask);
+    mask &= ~(1 << level);
+    for (p = this->queue[level].tail; p; p = p->mlfq.prev)
+      if (sched_movable(this, thief, p)) {
+        dequeue(this, p);
+        return p;
+      }
   }
+  return 0;
 }
 
 // MLFQ state logger
@@ -399,37 +933,61 @@ void
 mlfq_log(struct mlfq* this, int maxproc)
 {
   int i, j;
+  struct proc* p;
   struct stride* stride = &this->metasched;
   cprintf("----------\n");
-  cprintf("tick: %d\n", sys_uptime());
-  for (i = 0; i < maxproc; ++i) {
-    cprintf("%p(", stride->queue[i]);
-    if (stride->queue[i] != MLFQ_PROC && stride->queue[i]) {
-      cprintf("%s, ", stride->queue[i]->name);
+  cprintf("tick: %d\n", readticks());
+  for (i = 0; i < stride->nheap && i < maxproc; ++i) {
+    j = stride->heap[i];
+    cprintf("%p(", stride->queue[j]);
+    if (stride->queue[j] != MLFQ_PROC) {
+      cprintf("%s, ", stride->queue[j]->name);
     }
-    cprintf("%d, %d) ", stride->ticket[i], (int)stride->pass[i]);
+    cprintf("%d, %d) ", stride->ticket[j], (uint)(stride->pass[j] >> PASSSHIFT));
   }
   cprintf("\n");
-  for (i = 0; i < 3; ++i) {
-    for (j = 0; j < maxproc; ++j) {
-      cprintf("%p(", this->queue[i][j]);
-      if (this->queue[i][j])
-        cprintf("%s, %d, %d", this->queue[i][j]->name, this->queue[i][j]->mlfq.start, this->queue[i][j]->mlfq.elapsed);
-      cprintf(") ");
-    }
+  for (i = 0; i < NMLFQ; ++i) {
+    for (j = 0, p = this->queue[i].head; j < maxproc && p; ++j, p = p->mlfq.next)
+      cprintf("%p(%s, %d) ", p, p->name, (uint)p->mlfq.slice);
     cprintf("\n");
   }
 }
 
-// Check whether interrupt yield the process to scheduling CPU or not.
-int
-mlfq_yieldable(struct mlfq* this, struct proc* p)
+// Cycles left before interrupt yields the process to scheduling CPU.
+static uint64
+mlfq_remain(struct mlfq* this, struct proc* p)
 {
-  int dur = sys_uptime() - p->mlfq.start;
+  uint64 quantum;
+  uint64 dur = p->mlfq.slice + (rdtsc() - mycpu()->start);
+  // yield to EEVDF or EDF client woken up.
+  if (this->preempt)
+    return 0;
+  if (p->mlfq.level == EDF_LEVEL)
+    return edf_remain(&this->realtime, p);
+  if (p->mlfq.level == EEVDF_LEVEL)
+    return edf_until(&this->realtime, eevdf_remain(&this->latency, p));
   // yield if it use CPU time of RR time quantum.
-  return 
-    // for stride scheduler
-    (p->mlfq.level == -1 && dur >= this->metasched.quantum)
-    // for mlfq scheduler
-    || dur >= this->quantum[p->mlfq.level];
+  // for stride scheduler
+  if (p->mlfq.level == STRIDE_LEVEL)
+    quantum = cycles(this->metasched.quantum);
+  // for mlfq scheduler, quantum of the running thread's level
+  else
+    quantum = cycles(this->quantum[mycpu()->thread->mlfq.level]);
+  // yield when throttled EDF client gets its budget back.
+  return edf_until(&this->realtime, dur < quantum ? quantum - dur : 0);
 }
+
+struct schedops mlfq_ops = {
+  .name = "mlfq",
+  .init = mlfq_init,
+  .append = mlfq_append,
+  .enqueue = enqueue,
+  .dequeue = dequeue,
+  .wake = mlfq_wake,
+  .pick_next = mlfq_pick,
+  .thread = runnable,
+  .steal = mlfq_steal,
+  .tick = mlfq_tick,
+  .remain = mlfq_remain,
+  .remove = mlfq_remove,
+};
@@ -1,24 +1,72 @@
 // Stride scheduler context
 struct stride {
-  uint quantum;               // default time quantum
-  uint total;                 // total proportion of stride scheduling process
-  float pass[NPROC];          // pass values, sum of inverse ticket
+  uint quantum;               // default time quantum (microseconds)
+  uint total;                 // tickets reserved by stride clients, asleep or not
+  uint64 pass[NPROC];         // pass values, fixed point sum of strides
+  uint stride[NPROC];         // pass increment, inverse of ticket
   uint ticket[NPROC];         // proportion of stride scheduling process
-  struct proc* queue[NPROC];  // process queue
+  struct proc* queue[NPROC];  // process slots
+  int heap[NPROC];            // min-heap of runnable slots ordered by pass
+  int pos[NPROC];             // position of slot in heap, -1 if absent
+  int nheap;                  // number of slots in heap
 };
 
-// MLFQ scheduler context
+// Process level of the scheduling classes other than MLFQ.
+#define STRIDE_LEVEL    -1
+#define EEVDF_LEVEL     -2
+#define EDF_LEVEL       -3
+
+// Intrusive FIFO list of runnable processes,
+// linked through the member `mlfq.next` and `mlfq.prev` of process.
+struct runlist {
+  struct proc* head;
+  struct proc* tail;
+};
+
+// Earliest eligible virtual deadline first scheduler context
+struct eevdf {
+  uint total;                 // total proportion of clients
+  struct runlist queue;       // runnable clients
+};
+
+// Earliest deadline first scheduler context
+struct edf {
+  uint total;                 // total density of clients
+  uint64 release;             // earliest next period of throttled clients
+  uint nmiss;                 // deadlines missed by clients
+  struct runlist queue;       // runnable clients
+};
+
+// Run queue of a cpu, context of the scheduling policies.
+// MLFQ scheduler uses every level and the stride scheduler,
+// the other policies use the top level only.
 struct mlfq {
-  uint quantum[NPROC];                // round robin time quantum
-  uint expire[NPROC];                 // time to downgrade level
-  struct proc* queue[NMLFQ][NPROC];   // process queue
+  struct spinlock lock;               // protects run queue and its processes
+  uint quantum[NMLFQ];                // round robin time quantum (us)
+  uint expire[NMLFQ];                 // time to downgrade level (us)
+  uint bitmap;                        // bit i is set if queue[i] is not empty
+  uint epoch;                         // number of priority boosts applied
+  uint nqueued;                       // number of processes in queue
+  struct runlist queue[NMLFQ];        // runnable process queue
   struct stride metasched;            // meta-scheduler for controlling proportion
-  struct proc** iterstate[NMLFQ];     // iterator state
+  struct eevdf latency;               // clients of bounded wakeup latency
+  struct edf realtime;                // periodic clients with deadlines
+  struct schedstat stat;              // scheduler statistics
+  struct cpu* cpu;                    // cpu owning the run queue
+  volatile uint idle;                 // if non-zero, owner cpu is halting
+  volatile uint preempt;              // if non-zero, running thread yields
+  uint64 idlecycles;                  // TSC cycles halted by owner cpu
+  uint64 retry;                       // cycles before idle cpu looks again
+                                      // for queued processes, 0 if none
+  uint64 vclock;                      // minimum vruntime for fair share
+  struct proc* volatile gang;         // gang inviting the owner cpu, or 0
 };
 
+// Bit of the cpu owning the run queue in affinity masks.
+#define CPUBIT(rq)      (1u << ((rq)->cpu - cpus))
+
 enum mlfqstate {
   MLFQ_SUCCESS = 0,
-  MLFQ_FULL_QUEUE = 1,
   MLFQ_NEXT = 2,
   MLFQ_KEEP = 3,
 };
@@ -10,12 +10,17 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
+#define TLSSIZE        64  // thread-local storage at the top of user stack
 
 #define NMLFQ         3  // number of multi-level feedback queue.
-#define MAXTICKET   100  // maximum number of ticket.
-#define MAXSTRIDE    80  // maximum number of stride tickets.
-#define MAXPASS      10000000  // maximum number of pass.
-#define SCALEPASS    100000  // scaling pass.
+#define TICKETPCT   100  // tickets per percent of cpu.
+#define MAXTICKET   (100*TICKETPCT)  // maximum number of ticket.
+#define MAXSTRIDE   (80*TICKETPCT)   // maximum number of active stride tickets.
+#define PASSSHIFT    12  // fraction bits of fixed point pass value.
+#define MIGRATECOST 500  // microseconds the cache stays warm after a run.
+#define MIGRATEIMB    2  // queued processes which let warm ones migrate.
 
-#define NTHREAD      16  // maximum number of threads.
+
+#define HZ          100  // timer ticks per second.
+#define TICKUS      (1000000/HZ)  // microseconds per tick.
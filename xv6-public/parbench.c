@@ -0,0 +1,91 @@
+/**
+ *  This program measures the scalability of threads in a process.
+ *  Fixed amount of computation is divided between threads,
+ * and the elapsed ticks are compared with the single thread.
+ *  Threads run on the other cpus in parallel, so the elapsed time
+ * should decrease until the number of threads reaches CPUS.
+ *  Same measurement is repeated with the process restricted to a cpu,
+ * where threads should not migrate nor speed up.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+#define WORK            (1 << 28)   // total iterations
+#define MAXTHREAD       8
+
+// Busy loop with given number of iterations.
+void*
+compute(void *arg)
+{
+  uint i;
+  uint n = (uint)arg;
+  volatile uint acc = 0;
+
+  for (i = 0; i < n; ++i)
+    acc += i;
+
+  thread_exit((void*)acc);
+  return 0;
+}
+
+// Return elapsed ticks for computation with given number of threads.
+int
+bench(int nthread)
+{
+  int i;
+  uint start;
+  void *retval;
+  thread_t threads[MAXTHREAD];
+
+  start = uptime_fast();
+  for (i = 0; i < nthread; ++i) {
+    if (thread_create(&threads[i], compute, (void*)(WORK / nthread)) != 0) {
+      printf(1, "thread_create failure\n");
+      exit();
+    }
+  }
+
+  for (i = 0; i < nthread; ++i)
+    thread_join(threads[i], &retval);
+
+  return uptime_fast() - start;
+}
+
+// Run the benchmark for each number of threads, counting migrations.
+void
+series(char *name)
+{
+  int n, ticks, base;
+  struct schedstat before, after;
+
+  base = 0;
+  printf(1, "%s, cpus: 0x%x\n", name, sched_getaffinity(0));
+  for (n = 1; n <= MAXTHREAD; n *= 2) {
+    getschedstat(&before);
+    ticks = bench(n);
+    getschedstat(&after);
+    if (n == 1)
+      base = ticks;
+    printf(1, "threads: %d, ticks: %d, speedup x100: %d, "
+           "migrations: %d, kept warm: %d\n",
+           n, ticks, ticks ? base * 100 / ticks : 0,
+           after.nmigrate - before.nmigrate, after.nhot - before.nhot);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  series("any cpu");
+
+  if (sched_setaffinity(0, 1) != 0 || sched_getaffinity(0) != 1) {
+    printf(1, "sched_setaffinity failure\n");
+    exit();
+  }
+  series("pinned");
+  exit();
+}
@@ -2,18 +2,47 @@
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
 #include "mlfq.h"
+#include "sched.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
-#include "spinlock.h"
+#include "slab.h"
+
+// Mask of the cpus online.
+#define ALLCPUS ((1u << ncpu) - 1)
+
+#define WAITQSHIFT 6
+#define NWAITQ (1 << WAITQSHIFT)   // number of wait queues
+
+// Wait queue of the channel, Fibonacci hashing.
+#define WAITQ(chan) \
+  (&ptable.waitq[((uint)(chan) * 2654435761u) >> (32 - WAITQSHIFT)])
+
+#define NTIDHASH 128              // number of thread ID chains, power of two
+
+// Chain of the thread ID. Thread IDs are sequential,
+// so live threads spread evenly over the chains.
+#define TIDHASH(tid) (&ptable.tidhash[(uint)(tid) & (NTIDHASH - 1)])
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct thread *waitq[NWAITQ];   // sleeping threads hashed by channel
+  struct thread *tidhash[NTIDHASH]; // threads hashed by thread ID
+  uint nwakeup;                   // number of wakeups
+  uint ninspect;                  // threads inspected by wakeups
+  uint nwoken;                    // threads woken by wakeups
 } ptable;
 
-struct mlfq mlfq;
+// Run queue per cpu.
+struct mlfq runqueue[NCPU];
+
+// Thread records of every process.
+static struct slab threadslab;
 
 static struct proc *initproc;
 
@@ -24,11 +53,173 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+// Change thread state, notifying the scheduler
+// when thread enters or leaves the runnable state.
+// The ptable lock must be held, except for the running thread
+// changing its own state.
+static void
+setstate(struct proc *p, struct thread *t, enum procstate state)
+{
+  struct mlfq *rq;
+  struct thread **q;
+  int ready = t->state != RUNNABLE && state == RUNNABLE;
+  int unready = t->state == RUNNABLE && state != RUNNABLE;
+
+  // Sleeping thread waits in the queue of its channel.
+  if (t->state != SLEEPING && state == SLEEPING) {
+    q = WAITQ(t->chan);
+    t->wprev = 0;
+    t->wnext = *q;
+    if (*q)
+      (*q)->wprev = t;
+    *q = t;
+  } else if (t->state == SLEEPING && state != SLEEPING) {
+    if (state == RUNNABLE)
+      TRACE(TR_WAKEUP, p, t);
+    if (t->wprev)
+      t->wprev->wnext = t->wnext;
+    else
+      *WAITQ(t->chan) = t->wnext;
+    if (t->wnext)
+      t->wnext->wprev = t->wprev;
+    t->wnext = 0;
+    t->wprev = 0;
+    // Woken up before the deadline.
+    timerdel(&t->timer);
+  }
+
+  if (!ready && !unready) {
+    t->state = state;
+    return;
+  }
+
+  // Run queue of the process may be scanned by the other cpus.
+  rq = sched_lock(p);
+  t->state = state;
+  if (ready)
+    sched_ready(rq, p, t);
+  else
+    sched_unready(rq, p, t);
+  release(&rq->lock);
+}
+
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
-  mlfq_init(&mlfq);
+  slabinit(&threadslab, "thread", sizeof(struct thread));
+  timerinit(readticks());
+
+  for (i = 0; i < ncpu; ++i) {
+    sched_init(&runqueue[i], &cpus[i]);
+    cpus[i].rq = &runqueue[i];
+  }
+}
+
+// Link new thread record to the process, allocated from the slab.
+// The first thread stays at the head of the list.
+// The ptable lock must be held, except for the embryo process.
+static struct thread*
+newthread(struct proc *p)
+{
+  struct thread *t;
+
+  if ((t = slaballoc(&threadslab)) == 0)
+    return 0;
+  t->proc = p;
+  t->timer.arg = t;
+  if (p->threads) {
+    t->pnext = p->threads->pnext;
+    p->threads->pnext = t;
+  } else
+    p->threads = t;
+  return t;
+}
+
+// Assign new thread ID to the thread and hash it.
+// The ptable lock must be held.
+static void
+settid(struct thread *t)
+{
+  struct thread **q;
+
+  t->tid = nexttid++;
+  q = TIDHASH(t->tid);
+  t->hprev = 0;
+  t->hnext = *q;
+  if (*q)
+    (*q)->hprev = t;
+  *q = t;
+}
+
+// Unhash thread ID of the thread, if any.
+// The ptable lock must be held.
+static void
+cleartid(struct thread *t)
+{
+  if (t->tid == 0)
+    return;
+  if (t->hprev)
+    t->hprev->hnext = t->hnext;
+  else
+    *TIDHASH(t->tid) = t->hnext;
+  if (t->hnext)
+    t->hnext->hprev = t->hprev;
+  t->hnext = 0;
+  t->hprev = 0;
+  t->tid = 0;
+}
+
+// Find thread record by thread ID, 0 if none.
+// The ptable lock must be held.
+static struct thread*
+lookuptid(int tid)
+{
+  struct thread *t;
+
+  for (t = *TIDHASH(tid); t; t = t->hnext)
+    if (t->tid == tid)
+      return t;
+  return 0;
+}
+
+// Unused thread record of the process, reusing the one left by
+// a joined thread with its stacks, or a new one.
+// The ptable lock must be held.
+static struct thread*
+allocthread(struct proc *p)
+{
+  struct thread *t;
+
+  for (t = p->threads; t; t = t->pnext)
+    if (t->state == UNUSED)
+      return t;
+  return newthread(p);
+}
+
+// Unlink thread record from its process. The ptable lock must be held.
+static void
+unlinkthread(struct proc *p, struct thread *t)
+{
+  struct thread **pp;
+
+  for (pp = &p->threads; *pp; pp = &(*pp)->pnext)
+    if (*pp == t) {
+      *pp = t->pnext;
+      break;
+    }
+  t->pnext = 0;
+}
+
+// Free unlinked thread record and its kernel stack.
+static void
+freethread(struct thread *t)
+{
+  if (t->kstack)
+    kfree(t->kstack);
+  slabfree(&threadslab, t);
 }
 
 // Must be called with interrupts disabled
@@ -70,6 +261,65 @@ myproc(void) {
   return p;
 }
 
+// Disable interrupts so that we are not rescheduled
+// while reading thread from the cpu structure
+struct thread*
+mythread(void) {
+  struct thread *t;
+  pushcli();
+  t = mycpu()->thread;
+  popcli();
+  return t;
+}
+
+// Check whether the current thread is killed,
+// by kill() of the process or by exit and exec of the other thread.
+int
+killed(void)
+{
+  struct thread *t = mythread();
+  return t->proc->killed || t->killed;
+}
+
+// Kill the other threads of the current process
+// and wait until they become zombie.
+// They exit when they return to user space.
+// Return -1 if the current thread is killed by the other thread.
+int
+killthreads(void)
+{
+  int alive;
+  struct thread *t;
+  struct thread *cur = mythread();
+  struct proc *p = cur->proc;
+
+  acquire(&ptable.lock);
+  for (;;) {
+    if (cur->killed) {
+      release(&ptable.lock);
+      return -1;
+    }
+
+    alive = 0;
+    for (t = p->threads; t; t = t->pnext) {
+      if (t == cur || t->state == UNUSED || t->state == ZOMBIE)
+        continue;
+      alive = 1;
+      t->killed = 1;
+      // Wake thread from sleep if necessary.
+      if (t->state == SLEEPING)
+        setstate(p, t, RUNNABLE);
+    }
+    if (!alive)
+      break;
+
+    // Killed thread wakes us up at its epilogue.
+    sleep(p, &ptable.lock);
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -80,8 +330,9 @@ allocproc(void)
 {
   struct proc *p;
   struct thread* t;
+  struct thread* cur;
+  struct mlfq *rq;
   char *sp;
-  int off;
 
   acquire(&ptable.lock);
 
@@ -93,32 +344,47 @@ allocproc(void)
   return 0;
 
 found:
+  // Thread records of the exited process were freed by wait(),
+  // the one left by the failed allocation is reused.
+  if((t = p->threads) == 0 && (t = newthread(p)) == 0){
+    release(&ptable.lock);
+    return 0;
+  }
+
   // Set default process, thread states.
   p->state = EMBRYO;
   p->pid = nextpid++;
-  p->tidx = 0;
+  p->nrunnable = 0;
+  p->rhead = 0;
+  p->rtail = 0;
 
-  t = p->threads;
+  // Record left by the failed allocation may keep its thread ID.
   t->state = EMBRYO;
-  t->tid = nexttid++;
-
-  // Add process to MLFQ scheulder.
-  mlfq_append(&mlfq, p, 0);
+  cleartid(t);
+  settid(t);
+  t->killed = 0;
+  mlfq_thread_init(t);
+
+  // Child inherits the affinity of the forking thread.
+  cur = mythread();
+  p->affinity = cur ? cur->proc->affinity : ~0;
+  t->affinity = cur ? cur->affinity : ~0;
+  p->mlfq.cpus = p->affinity & t->affinity;
+
+  // Add process to MLFQ scheulder of the current cpu if allowed,
+  // it moves to the idle cpus by work stealing.
+  rq = sched_place(p->mlfq.cpus);
+  acquire(&rq->lock);
+  sched_append(rq, p);
+  release(&rq->lock);
   release(&ptable.lock);
 
-  // Reset stacks.
-  for (off = 0; off < NTHREAD; ++off) {
-    p->kstacks[off] = 0;
-    p->ustacks[off] = 0;
-  }
-
   // Allocate kernel stack.
-  if((p->kstacks[0] = kalloc()) == 0){
+  if((t->kstack = kalloc()) == 0){
     p->state = UNUSED;
     t->state = UNUSED;
     return 0;
   }
-  t->kstack = p->kstacks[0];
   sp = t->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -161,6 +427,7 @@ userinit(void)
   t->tf->ds = (SEG_UDATA << 3) | DPL_USER;
   t->tf->es = t->tf->ds;
   t->tf->ss = t->tf->ds;
+  t->tf->gs = (SEG_UTLS << 3) | DPL_USER;
   t->tf->eflags = FL_IF;
   t->tf->esp = PGSIZE;
   t->tf->eip = 0;  // beginning of initcode.S
@@ -175,9 +442,78 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
-  t->state = RUNNABLE;
+  setstate(p, t, RUNNABLE);
+
+  release(&ptable.lock);
+}
+
+// Flush the TLB of the cpus running threads of p, and wait until
+// they have done it. Caller must not hold ptable.lock, since the
+// target cpu may be spinning on it with interrupts disabled.
+static void
+tlbshootdown(struct proc *p)
+{
+  int i;
+  uint gen[NCPU];
+  uint mask = 0;
+
+  // Cpu switching to p after this loads the cleared page table.
+  __sync_synchronize();
+  pushcli();
+  for(i = 0; i < ncpu; i++){
+    gen[i] = cpus[i].tlbgen;
+    if(cpus[i].proc == p && &cpus[i] != mycpu()){
+      mask |= 1 << i;
+      lapicipi(cpus[i].apicid, T_IRQ0 + IRQ_TLB);
+    }
+  }
+  popcli();
+  for(i = 0; i < ncpu; i++)
+    if(mask & (1 << i))
+      while(cpus[i].tlbgen == gen[i])
+        ;
+}
+
+// Shrink current process's memory by n bytes.
+// Sibling threads on the other cpus may still reach the unmapped
+// pages through their TLB, so the pages are freed in batches of
+// a page worth of pointers after the TLB shootdown.
+static int
+shrinkproc(uint n)
+{
+  uint sz, newsz;
+  int i, npage;
+  char **pages;
+  struct proc *curproc = myproc();
+
+  if((pages = (char**)kalloc()) == 0)
+    return -1;
+  acquire(&ptable.lock);
+  if(n >= curproc->sz){
+    release(&ptable.lock);
+    kfree((char*)pages);
+    return -1;
+  }
+  // Sibling may have shrunk it meanwhile.
+  while(n > 0 && n < (sz = curproc->sz)){
+    newsz = sz - n;
+    if(PGROUNDUP(sz) - PGROUNDUP(newsz) > PGSIZE / sizeof(char*) * PGSIZE)
+      newsz = PGROUNDUP(sz) - PGSIZE / sizeof(char*) * PGSIZE;
+    npage = unmapuvm(curproc->pgdir, sz, newsz, pages);
+    n -= sz - newsz;
+    curproc->sz = newsz;
+    switchuvm(curproc);
+    release(&ptable.lock);
 
+    if(npage > 0)
+      tlbshootdown(curproc);
+    for(i = 0; i < npage; i++)
+      kfree(pages[i]);
+    acquire(&ptable.lock);
+  }
   release(&ptable.lock);
+  kfree((char*)pages);
+  return 0;
 }
 
 // Grow current process's memory by n bytes.
@@ -188,16 +524,21 @@ growproc(int n)
   uint sz;
   struct proc *curproc = myproc();
 
+  if(n < 0)
+    return shrinkproc(-n);
+
+  // Threads on the other cpus may grow memory at the same time.
+  acquire(&ptable.lock);
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
-  } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&ptable.lock);
       return -1;
+    }
   }
   curproc->sz = sz;
   switchuvm(curproc);
+  release(&ptable.lock);
   return 0;
 }
 
@@ -207,9 +548,12 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid, tmp;
+  int i, pid;
   struct proc *np;
+  uint tlshdr[2];
+  struct thread *t, *nt;
   struct proc *curproc = myproc();
+  struct thread *curthread = mythread();
 
   // Allocate process.
   if((np = allocproc()) == 0){
@@ -221,7 +565,6 @@ fork(void)
     kfree(np->threads->kstack);
     np->threads->kstack = 0;
     np->threads->state = UNUSED;
-    np->kstacks[0] = 0;
     np->state = UNUSED;
     return -1;
   }
@@ -229,18 +572,25 @@ fork(void)
   np->sz = curproc->sz;
   np->parent = curproc;
 
-  np->tidx = 0;
-  // Copy user stack pool.
-  for (i = 0; i < NTHREAD; ++i)
-    np->ustacks[i] = curproc->ustacks[i];
-
-  // Swap stacks of current thread index and index 0.
-  tmp = np->ustacks[0];
-  np->ustacks[0] = np->ustacks[curproc->tidx];
-  np->ustacks[curproc->tidx] = tmp;
+  // Copy user stack pool, the stack of current thread
+  // belongs to the first thread. Records of the other stacks
+  // are unused until the threads created in the child reuse them.
+  acquire(&ptable.lock);
+  np->threads->ustack = curthread->ustack;
+  for (t = curproc->threads; t; t = t->pnext)
+    if (t != curthread && t->ustack && (nt = newthread(np)) != 0)
+      nt->ustack = t->ustack;
+  release(&ptable.lock);
 
   // Copy trapframe, it will return to instruction `retn` of fork syscall.
-  *np->threads->tf = *curproc->threads[curproc->tidx].tf;
+  *np->threads->tf = *curthread->tf;
+
+  // Thread-local storage of the child holds its own thread ID.
+  if((np->threads->tls = curthread->tls) != 0){
+    tlshdr[0] = np->threads->tid;
+    tlshdr[1] = curthread->tls;
+    copyout(np->pgdir, curthread->tls, tlshdr, sizeof tlshdr);
+  }
 
   // Clear %eax so that fork returns 0 in the child.
   np->threads->tf->eax = 0;
@@ -257,7 +607,7 @@ fork(void)
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
-  np->threads->state = RUNNABLE;
+  setstate(np, np->threads, RUNNABLE);
 
   release(&ptable.lock);
 
@@ -278,6 +628,11 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  // Other threads may run on the other cpus.
+  // Only one of them exits the process, the others exit the thread.
+  if(killthreads() < 0)
+    thread_epilogue();
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -307,10 +662,13 @@ exit(void)
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
-  for (t = curproc->threads; t < &curproc->threads[NTHREAD]; t++)
+  for (t = curproc->threads; t; t = t->pnext)
     if (t->state != UNUSED)
-      t->state = ZOMBIE;
+      setstate(curproc, t, ZOMBIE);
 
+  // Scheduler runs with the lock of run queue, not ptable.
+  acquire(&mycpu()->rq->lock);
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -322,7 +680,7 @@ wait(void)
 {
   struct proc *p;
   struct thread *t;
-  int havekids, pid, off;
+  int havekids, pid;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
@@ -336,17 +694,14 @@ wait(void)
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
+        // Delete process from MLFQ,
+        // it waits until the process is switched out.
+        sched_delete(p);
         // Free all zombie threads.
-        for (t = p->threads; t < &p->threads[NTHREAD]; t++) {
-          off = t - p->threads;
-          if (p->kstacks[off] != 0) {
-            kfree(p->kstacks[off]);
-            p->kstacks[off] = 0;
-            p->ustacks[off] = 0;
-          }
-          t->kstack = 0;
-          t->state = UNUSED;
-          t->tid = 0;
+        while ((t = p->threads) != 0) {
+          unlinkthread(p, t);
+          cleartid(t);
+          freethread(t);
         }
         freevm(p->pgdir);
         p->pid = 0;
@@ -354,15 +709,13 @@ wait(void)
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
-        // Delete process from MLFQ.
-        mlfq_delete(&mlfq, p);
         release(&ptable.lock);
         return pid;
       }
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
+    if(!havekids || killed()){
       release(&ptable.lock);
       return -1;
     }
@@ -380,14 +733,96 @@ wait(void)
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+// The lock of run queue is held across the context switch,
+// it is the process's job to release it and reacquire it
+// before jumping back to us.
 void
 scheduler(void)
 {
-  mlfq_scheduler(&mlfq, &ptable.lock);
+  int keep, halt;
+  uint64 used;
+  struct proc *p = 0;
+  struct thread *t;
+  struct mlfq *rq;
+  struct cpu *c = mycpu();
+  struct mlfq *this = c->rq;
+
+  c->proc = 0;
+  c->thread = 0;
+
+  keep = MLFQ_NEXT;
+  for(;;){
+    // Enable interrupts on this processor.
+    sti();
+
+    acquire(&this->lock);
+    halt = 0;
+    do {
+      // Thread of the gang invited this cpu runs first.
+      if(this->gang && (t = sched_follow(this)) != 0){
+        p = t->proc;
+        c->follow = 1;
+        goto run;
+      }
+
+      p = sched_pick(this, keep == MLFQ_KEEP ? p : 0, &t);
+      if(p == 0){
+        // Find work from the other cpus,
+        // or halt until the wakeup if nothing to steal.
+        // Lock was released while stealing, check again.
+        // Queued processes not runnable yet set the retry.
+        keep = MLFQ_NEXT;
+        if(!sched_steal(this) && (this->nqueued == 0 || this->retry))
+          halt = this->idle = 1;
+        break;
+      }
+
+      // Switch to chosen thread.
+      sched_dispatch(this, p, t);
+    run:
+      c->proc = p;
+      c->thread = t;
+      TRACE(TR_DISPATCH, p, t);
+      switchuvm(p);
+      t->state = RUNNING;
+
+      // Interrupt is not needed without competition.
+      c->start = rdtsc();
+      if(!c->follow)
+        sched_gang(this, p);
+      clockarm(sched_timeout(this, p));
+      swtch(&(c->scheduler), t->context);
+      switchkvm();
+      used = rdtsc() - c->start;
+
+      // Process might move to the other run queue while running.
+      rq = this;
+      if(p->mlfq.rq != this){
+        release(&this->lock);
+        rq = sched_lock(p);
+      }
+
+      keep = sched_done(rq, p, t, used);
+
+      if(rq != this){
+        release(&rq->lock);
+        acquire(&this->lock);
+        keep = MLFQ_NEXT;
+      }
+
+      c->proc = 0;
+      c->thread = 0;
+      c->follow = 0;
+    } while(0);
+    release(&this->lock);
+
+    if(halt)
+      sched_idle(this);
+  }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed proc->state. Saves and restores
+// Enter scheduler.  Must hold only the lock of
+// run queue of this cpu and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -397,15 +832,13 @@ void
 sched(void)
 {
   int intena;
-  struct proc *p = myproc();
-  struct thread *t;
+  struct thread *t = mythread();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&mycpu()->rq->lock))
+    panic("sched rq->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
 
-  t = &p->threads[p->tidx];
   if(t->state == RUNNING)
     panic("sched running");
   if(readeflags()&FL_IF)
@@ -415,47 +848,18 @@ sched(void)
   mycpu()->intena = intena;
 }
 
-// Context switching between threads.
-// It do not reload the cr3 but update only address of kernel stack
-// for previlege escalation.
+// Switch to the other runnable thread of the current process.
+// Scheduler keeps the process while its quantum remains,
+// and picks the next thread in round robin order.
 void
 next_thread(struct proc* p) {
-  int intena;
-  struct thread* iter;
-  struct thread* t = &p->threads[p->tidx];
-  acquire(&ptable.lock);
-
-  // Find runnable thread.
-  for (iter = t + 1; ; ++iter) {
-    if (iter == &p->threads[NTHREAD])
-      iter = p->threads;
-    if (iter == t) {
-      // If runnable thread does not exist and
-      // current thread is also not runnable.
-      if (t->state != RUNNING) {
-        sched();
-        panic("next_thread cannot run thread");
-      }
-      break;
-    }
-
-    // If runnable thread found.
-    if (iter->state == RUNNABLE) {
-      t->state = RUNNABLE;
-      iter->state = RUNNING;
-
-      // Update running thread index.
-      p->tidx = iter - p->threads;
-      switch_trap_kstack(p);
-
-      // Context switch.
-      intena = mycpu()->intena;
-      swtch(&t->context, iter->context);
-      mycpu()->intena = intena;
-      break;
-    }
-  }
-  release(&ptable.lock);
+  // Unlocked peek, other threads are not runnable.
+  // Thread becoming runnable later will run at the next tick.
+  // Thread following the gang keeps the cpu of the round.
+  if (p->nrunnable == 0 || mycpu()->follow)
+    return;
+  TRACE(TR_SWITCH, p, mythread());
+  yield();
 }
 
 // Give up the CPU for one scheduling round.
@@ -463,11 +867,13 @@ void
 yield(void)
 {
   struct proc *p;
-  acquire(&ptable.lock);  //DOC: yieldlock
+  pushcli();
   p = myproc();
-  p->threads[p->tidx].state = RUNNABLE;
+  setstate(p, mycpu()->thread, RUNNABLE);
+  acquire(&mycpu()->rq->lock);  //DOC: yieldlock
+  popcli();
   sched();
-  release(&ptable.lock);
+  release(&mycpu()->rq->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -476,8 +882,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding the lock of run queue from scheduler.
+  release(&mycpu()->rq->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -491,13 +897,16 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
-// Atomically release lock and sleep on chan.
+// Atomically release lock and sleep on chan,
+// until the tick `deadline` if `timed` is non-zero.
 // Reacquires lock when awakened.
-void
-sleep(void *chan, struct spinlock *lk)
+// It returns non-zero if the deadline passed.
+static int
+sleep1(void *chan, struct spinlock *lk, int timed, uint deadline)
 {
+  int expired;
   struct proc *p = myproc();
-  struct thread *t;
+  struct thread *t = mythread();
 
   if(p == 0)
     panic("sleep");
@@ -515,21 +924,57 @@ sleep(void *chan, struct spinlock *lk)
     acquire(&ptable.lock);  //DOC: sleeplock1
     release(lk);
   }
+
+  // Timer interrupt advances the ticks before the timers,
+  // with ptable.lock held, so the deadline cannot be missed.
+  if (timed && (int)(readticks() - deadline) >= 0) {
+    if (lk != &ptable.lock) {
+      release(&ptable.lock);
+      acquire(lk);
+    }
+    return 1;
+  }
+
   // Go to sleep.
-  t = &p->threads[p->tidx];
+  TRACE(TR_SLEEP, p, t);
   t->chan = chan;
-  t->state = SLEEPING;
+  setstate(p, t, SLEEPING);
+  if (timed) {
+    timeradd(&t->timer, deadline);
+    clockwake(deadline);
+  }
 
+  // Switch with the lock of run queue,
+  // wakeup cannot dispatch this thread until it is switched out.
+  acquire(&mycpu()->rq->lock);
+  release(&ptable.lock);
   sched();
+  release(&mycpu()->rq->lock);
 
   // Tidy up.
   t->chan = 0;
+  expired = timed && (int)(readticks() - deadline) >= 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);
+  return expired;
+}
+
+// Atomically release lock and sleep on chan.
+// Reacquires lock when awakened.
+void
+sleep(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 0, 0);
+}
+
+// Sleep on chan like sleep(), until woken up or the tick `deadline`.
+// It returns non-zero if the deadline passed, caller still checks
+// its condition since it may be woken up for the others.
+int
+sleepuntil(void *chan, struct spinlock *lk, uint deadline)
+{
+  return sleep1(chan, lk, 1, deadline);
 }
 
 //PAGEBREAK!
@@ -538,14 +983,18 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
-  struct thread *t;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == RUNNABLE)
-      for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-        if (t->state == SLEEPING && t->chan == chan)
-          t->state = RUNNABLE;
+  struct thread *t, *next;
+
+  // Only the queue of the channel, shared with the colliding channels.
+  ptable.nwakeup++;
+  for (t = *WAITQ(chan); t; t = next) {
+    next = t->wnext;
+    ptable.ninspect++;
+    if (t->chan == chan && t->proc->state == RUNNABLE) {
+      setstate(t->proc, t, RUNNABLE);
+      ptable.nwoken++;
+    }
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -557,6 +1006,101 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Kernel address of the futex word at user address `addr`, or zero.
+// It identifies the word of the address space while the page is mapped,
+// so that it is the channel of the threads waiting on the word.
+static uint*
+futexword(struct proc *p, uint *addr)
+{
+  char *page;
+
+  if ((uint)addr % sizeof(uint) || (uint)addr >= p->sz)
+    return 0;
+  if ((page = uva2ka(p->pgdir, (char*)addr)) == 0)
+    return 0;
+  return (uint*)(page + ((uint)addr & (PGSIZE - 1)));
+}
+
+// Sleep on the futex word at `addr` if it still holds `expected`,
+// until woken up by futex_wake() or `timeout` ticks pass, if positive.
+// Word is compared holding ptable.lock, so that the wakeup between
+// the comparison and the sleep cannot be missed.
+// It returns 0 when woken up, -1 if the word differs or it is invalid,
+// and -2 if timed out.
+int
+futex_wait(uint *addr, uint expected, int timeout)
+{
+  int ret = 0;
+  uint *word;
+  struct proc *p = myproc();
+
+  acquire(&ptable.lock);
+  if ((word = futexword(p, addr)) == 0 || *word != expected) {
+    release(&ptable.lock);
+    return -1;
+  }
+  if (timeout > 0) {
+    if (sleepuntil(word, &ptable.lock, readticks() + timeout))
+      ret = -2;
+  } else
+    sleep(word, &ptable.lock);
+  release(&ptable.lock);
+  return ret;
+}
+
+// Wake up to `n` threads waiting on the futex word at `addr`,
+// the ones waiting longest first.
+// It returns the number of threads woken up, or -1 if it is invalid.
+int
+futex_wake(uint *addr, int n)
+{
+  int woken = 0;
+  uint *word;
+  struct thread *t, *prev;
+
+  acquire(&ptable.lock);
+  if ((word = futexword(myproc(), addr)) == 0) {
+    release(&ptable.lock);
+    return -1;
+  }
+
+  // Waiters are pushed at the head of the queue.
+  ptable.nwakeup++;
+  for (t = *WAITQ(word); t && t->wnext; t = t->wnext)
+    ;
+  for (; t && woken < n; t = prev) {
+    prev = t->wprev;
+    ptable.ninspect++;
+    if (t->chan == word && t->proc->state == RUNNABLE) {
+      setstate(t->proc, t, RUNNABLE);
+      ptable.nwoken++;
+      woken++;
+    }
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
+// Wake up the threads of which deadline expired,
+// called by the timer interrupt after advancing the ticks.
+void
+timerintr(void)
+{
+  struct timer expired;
+  struct thread *t;
+
+  acquire(&ptable.lock);
+  expired.next = expired.prev = &expired;
+  timeradvance(readticks(), &expired);
+  while (expired.next != &expired) {
+    t = expired.next->arg;
+    timerdel(&t->timer);
+    if (t->state == SLEEPING && t->proc->state == RUNNABLE)
+      setstate(t->proc, t, RUNNABLE);
+  }
+  release(&ptable.lock);
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -570,10 +1114,10 @@ kill(int pid)
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
       p->killed = 1;
-      for (t = p->threads; t < &p->threads[NTHREAD]; t++)
+      for (t = p->threads; t; t = t->pnext)
         // Wake process from sleep if necessary.
         if (t->state == SLEEPING)
-          t->state = RUNNABLE;
+          setstate(p, t, RUNNABLE);
 
       release(&ptable.lock);
       return 0;
@@ -608,7 +1152,7 @@ procdump(void)
     if(p->state == UNUSED)
       continue;
     
-    t = &p->threads[p->tidx];
+    t = p->threads;
     if(t->state >= 0 && t->state < NELEM(states) && states[t->state])
       state = states[t->state];
     else
@@ -627,11 +1171,17 @@ procdump(void)
 int
 getlev(void)
 {
+  int level;
+  struct mlfq* rq;
   struct proc* p = myproc();
-  if (p == 0)
+  // Levels belong to MLFQ scheduler.
+  if (p == 0 || schedops != &mlfq_ops)
     return -1;
-  
-  return p->mlfq.level;
+
+  rq = sched_lock(p);
+  level = mlfq_level(rq, p);
+  release(&rq->lock);
+  return level;
 }
 
 // Move process from MLFQ scheulder to stride scheduler
@@ -639,7 +1189,360 @@ getlev(void)
 int
 set_cpu_share(int percent)
 {
-  return mlfq_cpu_share(&mlfq, myproc(), percent);
+  if (percent <= 0 || percent > 100)
+    return -1;
+  return set_cpu_fraction(percent, 100);
+}
+
+// Move process to stride scheduler with `num`/`den` of CPU,
+// a fraction of a percent is rounded down to the ticket.
+int
+set_cpu_fraction(int num, int den)
+{
+  int ret;
+  if (schedops != &mlfq_ops)
+    return -1;
+  if (num <= 0 || num > den || den > MAXTICKET)
+    return -1;
+
+  // Threads of the process may request at the same time.
+  acquire(&ptable.lock);
+  ret = mlfq_cpu_share(myproc(), num * MAXTICKET / den);
+  release(&ptable.lock);
+  return ret;
+}
+
+// Find live thread of the current process by thread ID,
+// zero means the current thread. The ptable lock must be held.
+static struct thread*
+findthread(int tid)
+{
+  struct thread *t;
+  struct proc *p = myproc();
+
+  if (tid == 0)
+    return mythread();
+  if ((t = lookuptid(tid)) != 0 && t->proc == p
+      && t->state != UNUSED && t->state != ZOMBIE)
+    return t;
+  return 0;
+}
+
+// Return MLFQ level of the thread in the current process.
+int
+thread_getlev(int tid)
+{
+  int level = -1;
+  struct thread *t;
+  struct mlfq *rq;
+
+  if (schedops != &mlfq_ops)
+    return -1;
+
+  acquire(&ptable.lock);
+  if ((t = findthread(tid)) != 0) {
+    rq = sched_lock(myproc());
+    level = mlfq_thread_level(rq, t);
+    release(&rq->lock);
+  }
+  release(&ptable.lock);
+  return level;
+}
+
+// Reserve given proportion of the current process's cpu time
+// for the thread, zero releases it.
+int
+thread_set_cpu_share(int tid, int percent)
+{
+  int ret = -1;
+  struct thread *t;
+
+  if (schedops != &mlfq_ops || percent < 0 || percent > 100)
+    return -1;
+
+  acquire(&ptable.lock);
+  if ((t = findthread(tid)) != 0)
+    ret = mlfq_thread_share(myproc(), t, percent * TICKETPCT);
+  release(&ptable.lock);
+  return ret;
+}
+
+// Find live process by process ID, zero means the current process.
+// The ptable lock must be held.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  if (pid == 0)
+    return myproc();
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; ++p)
+    if (p->pid == pid && p->state != UNUSED && p->state != ZOMBIE)
+      return p;
+  return 0;
+}
+
+// Place process on the cpus allowed to the process and every live thread,
+// threads are queued together in the run queue of the process.
+// It fails if no cpu is left or the process reserving a share
+// would leave its cpu. The ptable lock must be held.
+static int
+affine(struct proc *p)
+{
+  uint mask = p->affinity;
+  struct thread *t;
+
+  for (t = p->threads; t; t = t->pnext)
+    if (t->state != UNUSED && t->state != ZOMBIE)
+      mask &= t->affinity;
+  if ((mask &= ALLCPUS) == 0)
+    return -1;
+  return sched_migrate(p, mask);
+}
+
+// Give up the cpu if the current process is not allowed on it anymore,
+// scheduler moves the thread to the run queue of the process.
+static void
+leavecpu(void)
+{
+  int leave;
+
+  pushcli();
+  leave = !(myproc()->mlfq.cpus & CPUBIT(mycpu()->rq));
+  popcli();
+  if (leave) {
+    TRACE(TR_YIELD, myproc(), mythread());
+    yield();
+  }
+}
+
+// Restrict the process of given process ID, zero for the current one,
+// to the cpus of the mask.
+int
+sched_setaffinity(int pid, uint mask)
+{
+  int ret = -1;
+  uint old;
+  struct proc *p;
+
+  if ((mask & ALLCPUS) == 0)
+    return -1;
+
+  acquire(&ptable.lock);
+  if ((p = findproc(pid)) != 0) {
+    old = p->affinity;
+    p->affinity = mask;
+    if ((ret = affine(p)) < 0)
+      p->affinity = old;
+  }
+  release(&ptable.lock);
+
+  leavecpu();
+  return ret;
+}
+
+// Return the mask of cpus the process of given process ID may run on.
+int
+sched_getaffinity(int pid)
+{
+  int mask = -1;
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  if ((p = findproc(pid)) != 0)
+    mask = p->affinity & ALLCPUS;
+  release(&ptable.lock);
+  return mask;
+}
+
+// Restrict the thread of the current process to the cpus of the mask.
+// Process runs only on the cpus allowed to all of its threads,
+// so it fails if the mask excludes every cpu of the other threads.
+int
+thread_setaffinity(int tid, uint mask)
+{
+  int ret = -1;
+  uint old;
+  struct thread *t;
+
+  if ((mask & ALLCPUS) == 0)
+    return -1;
+
+  acquire(&ptable.lock);
+  if ((t = findthread(tid)) != 0) {
+    old = t->affinity;
+    t->affinity = mask;
+    if ((ret = affine(myproc())) < 0)
+      t->affinity = old;
+  }
+  release(&ptable.lock);
+
+  leavecpu();
+  return ret;
+}
+
+// Return the mask of cpus the thread of the current process may run on.
+int
+thread_getaffinity(int tid)
+{
+  int mask = -1;
+  struct thread *t;
+
+  acquire(&ptable.lock);
+  if ((t = findthread(tid)) != 0)
+    mask = t->affinity & ALLCPUS;
+  release(&ptable.lock);
+  return mask;
+}
+
+// Move process to EEVDF scheduler with given proportion of CPU usage,
+// requesting `slice` microseconds of CPU at once.
+int
+set_latency(int percent, int slice)
+{
+  int ret;
+  if (schedops != &mlfq_ops || percent <= 0 || percent > 100)
+    return -1;
+
+  // Threads of the process may request at the same time.
+  acquire(&ptable.lock);
+  ret = mlfq_latency(myproc(), percent * TICKETPCT, slice);
+  release(&ptable.lock);
+  return ret;
+}
+
+// Move process to EDF scheduler, reserving `runtime` microseconds of CPU
+// in every `period`, served within `deadline` from the start of period.
+int
+set_deadline(int runtime, int period, int deadline)
+{
+  int ret;
+  if (schedops != &mlfq_ops)
+    return -1;
+
+  // Threads of the process may request at the same time.
+  acquire(&ptable.lock);
+  ret = mlfq_deadline(myproc(), runtime, period, deadline);
+  release(&ptable.lock);
+  return ret;
+}
+
+// Copy the reservation of the current EDF process and its misses.
+int
+getdeadline(struct dlstat *st)
+{
+  int ret = -1;
+  struct mlfq *rq;
+  struct proc *p = myproc();
+
+  rq = sched_lock(p);
+  if (p->mlfq.level == EDF_LEVEL) {
+    st->runtime = p->mlfq.dlruntime;
+    st->period = p->mlfq.dlperiod;
+    st->deadline = p->mlfq.dldeadline;
+    st->njob = p->mlfq.dljobs;
+    st->nmiss = p->mlfq.dlmiss;
+    ret = 0;
+  }
+  release(&rq->lock);
+  return ret;
+}
+
+// Co-schedule the runnable threads of the current process across cpus
+// if `on` is non-zero, see sched_gang().
+int
+set_gang(int on)
+{
+  struct mlfq *rq;
+  struct proc *p = myproc();
+
+  rq = sched_lock(p);
+  p->mlfq.gang = on != 0;
+  release(&rq->lock);
+  return 0;
+}
+
+// Copy scheduler statistics, summed over all cpus.
+void
+getschedstat(struct schedstat *st)
+{
+  int i;
+  struct mlfq *rq;
+
+  memset(st, 0, sizeof(*st));
+  st->ncpu = ncpu;
+  for (i = 0; i < ncpu; ++i) {
+    rq = &runqueue[i];
+    acquire(&rq->lock);
+    st->npick += rq->stat.npick;
+    st->pickcycles += rq->stat.pickcycles;
+    st->nsteal += rq->stat.nsteal;
+    st->nmigrate += rq->stat.nmigrate;
+    st->nhot += rq->stat.nhot;
+    st->nfollow += rq->stat.nfollow;
+    st->nmiss += rq->realtime.nmiss;
+    st->nipi += rq->stat.nipi;
+    st->ntimer += rq->stat.ntimer;
+    st->ntrlost += rq->stat.ntrlost;
+    st->idle[i] = rq->idlecycles;
+    release(&rq->lock);
+  }
+
+  acquire(&ptable.lock);
+  st->nwakeup = ptable.nwakeup;
+  st->ninspect = ptable.ninspect;
+  st->nwoken = ptable.nwoken;
+  release(&ptable.lock);
+}
+
+// Copy scheduler parameters, same on every cpu.
+void
+getschedparam(struct schedparam *param)
+{
+  struct mlfq *rq = &runqueue[0];
+
+  acquire(&rq->lock);
+  mlfq_getparam(rq, param);
+  release(&rq->lock);
+}
+
+// Replace scheduler parameters of every cpu.
+int
+setschedparam(struct schedparam *param)
+{
+  int i;
+  struct mlfq *rq;
+
+  // Serialize with the other tuners.
+  acquire(&ptable.lock);
+  for (i = 0; i < ncpu; ++i) {
+    rq = &runqueue[i];
+    acquire(&rq->lock);
+    if (mlfq_setparam(rq, param) < 0) {
+      release(&rq->lock);
+      release(&ptable.lock);
+      return -1;
+    }
+    release(&rq->lock);
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Copy cumulative cpu time of the current process,
+// including the current run.
+void
+getruntime(struct runtime *rt)
+{
+  struct mlfq *rq;
+  struct proc *p = myproc();
+
+  pushcli();
+  rq = sched_lock(p);
+  rt->cycles = p->mlfq.runtime + (rdtsc() - mycpu()->start);
+  rt->tickcycles = tickcycles;
+  release(&rq->lock);
+  popcli();
 }
 
 // End of thread, make thread state zombie
@@ -652,12 +1555,25 @@ thread_epilogue(void) {
   acquire(&ptable.lock);
 
   p = myproc();
-  t = &p->threads[p->tidx];
+  t = mythread();
+
+  // Release the share of the process reserved by thread.
+  if (t->mlfq.ticket)
+    mlfq_thread_share(p, t, 0);
 
   // Update thread state.
-  t->state = ZOMBIE;
+  setstate(p, t, ZOMBIE);
+  // Process may spread to the cpus excluded by the thread.
+  if (p->affinity & ~t->affinity)
+    affine(p);
   wakeup1((void*)t->tid);
+  wakeup1(&p->threads);
+  // Thread killed by exit or exec of the other thread.
+  if (t->killed)
+    wakeup1(p);
 
+  acquire(&mycpu()->rq->lock);
+  release(&ptable.lock);
   sched();
   panic("thread_epilogue: unreachable statements");
 }
@@ -666,42 +1582,36 @@ thread_epilogue(void) {
 // and start routine.
 int
 thread_create(int *tid, void*(*start_routine)(void*), void *arg) {
-  int tidx, sz;
+  int sz;
   char *sp;
   struct proc *p;
   struct thread *t;
 
   acquire(&ptable.lock);
 
-  // Find unused thread slot.
+  // Find unused thread record.
   p = myproc();
-  for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-    if (t->state == UNUSED)
-      goto find;
-  
-  release(&ptable.lock);
-  return -1;
-
-find:
-  tidx = t - p->threads;
-  t->tid = nexttid++;
+  if ((t = allocthread(p)) == 0) {
+    release(&ptable.lock);
+    return -1;
+  }
+  settid(t);
 
-  // Allocate new kernel stack for isolating space.
-  if (p->kstacks[tidx] == 0 && (p->kstacks[tidx] = kalloc()) == 0) {
-    t->tid = 0;
+  // Allocate new kernel stack for isolating space,
+  // unused record keeps the stack of its previous thread.
+  if (t->kstack == 0 && (t->kstack = kalloc()) == 0) {
+    cleartid(t);
     t->state = UNUSED;
     release(&ptable.lock);
     return -1;
   }
-  // Assign allocated stack.
-  t->kstack = p->kstacks[tidx];
   sp = t->kstack + KSTACKSIZE;
 
   // Copy trapframe for recovering trivial bytes
   // (segment registers, etc..)
   sp -= sizeof *t->tf;
   t->tf = (struct trapframe*)sp;
-  *t->tf = *p->threads[p->tidx].tf;
+  *t->tf = *mythread()->tf;
 
   // Second return address is trapret.
   sp -= 4;
@@ -716,24 +1626,30 @@ find:
   t->context->eip = (uint)forkret;
 
   // Allocate user stack.
-  if (p->ustacks[tidx] != 0)
-    sz = p->ustacks[tidx];
+  if (t->ustack != 0)
+    sz = t->ustack;
   else {
     sz = PGROUNDUP(p->sz);
     if ((sz = allocuvm(p->pgdir, sz, sz + PGSIZE)) == 0) {
-      t->kstack = 0;
-      t->tid = 0;
+      cleartid(t);
       t->state = UNUSED;
       release(&ptable.lock);
       return -1;
     }
     
     p->sz = sz;
-    p->ustacks[tidx] = sz;
+    t->ustack = sz;
   }
 
+  // Thread-local storage at the top of the stack,
+  // starting with thread ID and its base, see settls().
+  sp = (char*)sz - TLSSIZE;
+  memset(sp, 0, TLSSIZE);
+  ((uint*)sp)[0] = t->tid;
+  ((uint*)sp)[1] = (uint)sp;
+  t->tls = (uint)sp;
+
   // Write argument for start routine.
-  sp = (char*)sz;
   sp -= 4;
   *(uint*)sp = (uint)arg;
 
@@ -752,56 +1668,144 @@ find:
   *tid = t->tid;
 
   t->retval = 0;
-  t->state = RUNNABLE;
+  t->killed = 0;
+  t->affinity = mythread()->affinity;
+  mlfq_thread_init(t);
+  setstate(p, t, RUNNABLE);
   release(&ptable.lock);
   return 0;
 }
 
+// Install thread-local storage of the current thread at `base`,
+// user space reads the thread ID and the base at %gs:0 and %gs:4
+// without a system call. It is written on the first two words.
+int
+settls(char *base)
+{
+  struct thread *t = mythread();
+
+  ((uint*)base)[0] = t->tid;
+  ((uint*)base)[1] = (uint)base;
+  t->tls = (uint)base;
+  loadtls(t);
+  return 0;
+}
+
+// Free thread of the current process discarded by exec.
+void
+thread_discard(struct thread *t)
+{
+  acquire(&ptable.lock);
+  setstate(myproc(), t, UNUSED);
+  cleartid(t);
+  unlinkthread(myproc(), t);
+  if (myproc()->affinity & ~t->affinity)
+    affine(myproc());
+  release(&ptable.lock);
+  freethread(t);
+}
+
 // Exit thread, write return value and run epilogue of thread.
 void
 thread_exit(void *retval) {
-  struct proc *p = myproc();
-  p->threads[p->tidx].retval = retval;
+  mythread()->retval = retval;
   thread_epilogue();
 }
 
+// Free zombie thread of the current process,
+// writing its return value. The ptable lock must be held.
+static void
+reapthread(struct proc *p, struct thread *t, void **retval)
+{
+  // Thread may be still switching out from the other cpu.
+  sched_offcpu(p, t);
+
+  // Write return value.
+  *retval = t->retval;
+
+  // Free exit thread, its record keeps the stacks for reuse.
+  t->state = UNUSED;
+  cleartid(t);
+  t->retval = 0;
+}
+
 // Wait until thread is done.
 // It acts like `wait` on exit process.
 // It clean up the exit thread and write the return value.
 int
 thread_join(int tid, void **retval) {
-  struct proc* p;
+  struct proc* p = myproc();
   struct thread* t;
 
   acquire(&ptable.lock);
-  // Searching given thread ID.
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; ++p)
-    if (p->state == RUNNABLE)
-      for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-        if (t->tid == tid)
-          goto found;    
+  // Wait until target thread is done. Thread IDs are never reused,
+  // so the thread is gone if joined by the other thread meanwhile.
+  while ((t = lookuptid(tid)) != 0 && t->proc == p
+         && t != mythread() && t->state != ZOMBIE) {
+    if (killed()) {
+      release(&ptable.lock);
+      return -1;
+    }
+    sleep((void*)tid, &ptable.lock);
+  }
+  if (t == 0 || t->proc != p || t == mythread()) {
+    release(&ptable.lock);
+    return -1;
+  }
 
+  reapthread(p, t, retval);
   release(&ptable.lock);
-  return -1;
-
-found:
-  // Wait until target thread is done.
-  do {
-    if (t->state == ZOMBIE)
-      break;
+  return 0;
+}
 
-    sleep((void*)tid, &ptable.lock);
-  } while (0);
+// Wait until any other thread of the current process is done,
+// and clean it up like thread_join.
+// It returns the thread ID, or -1 if there are no other threads.
+int
+thread_join_any(void **retval) {
+  int tid, alive;
+  struct proc* p = myproc();
+  struct thread* t;
 
-  // Write return value.
-  *retval = t->retval;
+  acquire(&ptable.lock);
+  for (;;) {
+    alive = 0;
+    for (t = p->threads; t; t = t->pnext) {
+      if (t == mythread() || t->state == UNUSED)
+        continue;
+      if (t->state == ZOMBIE) {
+        tid = t->tid;
+        reapthread(p, t, retval);
+        release(&ptable.lock);
+        return tid;
+      }
+      alive = 1;
+    }
+    if (!alive || killed()) {
+      release(&ptable.lock);
+      return -1;
+    }
+    // Finished thread wakes us up at its epilogue.
+    sleep(&p->threads, &ptable.lock);
+  }
+}
 
-  // Free exit thread.
-  t->kstack = 0;
-  t->state = UNUSED;
-  t->tid = 0;
-  t->retval = 0;
+// Kill the other thread of the current process,
+// it exits when it returns to user space.
+int
+thread_kill(int tid)
+{
+  struct thread *t;
 
+  acquire(&ptable.lock);
+  if ((t = findthread(tid)) == 0 || t == mythread()) {
+    release(&ptable.lock);
+    return -1;
+  }
+  t->killed = 1;
+  // Wake thread from sleep if necessary.
+  if (t->state == SLEEPING)
+    setstate(myproc(), t, RUNNABLE);
   release(&ptable.lock);
   return 0;
 }
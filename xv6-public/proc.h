@@ -8,6 +8,13 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct thread *thread;       // The thread running on this cpu or null
+  uint64 start;                // TSC when the thread was dispatched
+  struct mlfq *rq;             // Run queue of this cpu
+  volatile int tickless;       // if non-zero, periodic tick is stopped
+  volatile uint alarm;         // tick of the timer armed by tickless cpu 0
+  int follow;                  // if non-zero, thread follows the gang
+  volatile uint tlbgen;        // Count of TLB flushes requested by IPI
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +41,14 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Timer in the timer wheel, see timer.c.
+struct timer {
+  uint expire;                  // tick to expire
+  void *arg;                    // owner of the timer
+  struct timer *next;           // next timer in the slot, 0 if not armed
+  struct timer *prev;           // previous timer in the slot
+};
+
 // Per-thread state
 struct thread {
   enum procstate state;         // thread state
@@ -43,6 +58,29 @@ struct thread {
   struct trapframe *tf;         // trap frame for current interrupt handler.
   struct context *context;      // cpu context, swtch() here to run process
   void* retval;                 // return value
+  int oncpu;                    // if non-zero, running or switching out
+  int killed;                   // if non-zero, killed by the other thread
+  struct proc *proc;            // process owning the thread
+  struct thread *wnext;         // next thread in wait queue
+  struct thread *wprev;         // previous thread in wait queue
+  struct timer timer;           // wakes up sleeping thread, if armed
+  uint affinity;                // mask of cpus the thread may run on
+  uint ustack;                  // top of user stack, kept for reuse
+  struct thread *pnext;         // next thread of the process
+  int runnable;                 // if non-zero, linked in runnable list
+  struct thread *rnext;         // next runnable thread of the process
+  struct thread *rprev;         // previous runnable thread of the process
+  struct thread *hnext;         // next thread in thread ID chain
+  struct thread *hprev;         // previous thread in thread ID chain
+  uint tls;                     // base of thread-local storage, 0 if none
+
+  struct {
+    int level;                  // MLFQ level of the thread
+    uint64 elapsed;             // cpu time spent at the level (cycles)
+    uint epoch;                 // boost epoch of the level
+    uint ticket;                // share of the process's cpu time, 0 if none
+    uint64 pass;                // stride pass among threads of the process
+  } mlfq;                       // member for MLFQ scheduler
 };
 
 // Per-process state
@@ -57,17 +95,47 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 
-  int tidx;                         // index of running thread
-  struct thread threads[NTHREAD];   // thread pool
-  char* kstacks[NTHREAD];           // kernel stack pool
-  uint ustacks[NTHREAD];            // user stack pool
+  uint affinity;                    // mask of cpus the process may run on
+  struct thread *threads;           // thread pool, the first thread first,
+                                    // linked through `pnext`
+  int nrunnable;                    // number of runnable threads
+  struct thread *rhead;             // runnable threads in round robin order
+  struct thread *rtail;             // last runnable thread
 
   struct {
-    int level;                // scheduler level, -1 for stride, 0 ~ 3 for MLFQ
-    int index;                // index of process table in scheduler
-    uint elapsed;             // cpu time spent by process
-    uint start;               // start tick.
-  } mlfq;                     // member for MLFQ scheduler
+    int level;                // scheduler level, -1 for stride, -2 for EEVDF,
+                              // -3 for EDF,
+                              // 0 ~ 3 for MLFQ at the level of the best thread
+    int index;                // index of process table in stride scheduler
+    struct mlfq *rq;          // run queue holding the process
+    uint cpus;                // cpus allowed to every thread, see placement()
+    uint64 lastrun;           // TSC when a thread was switched out
+    uint64 slice;             // cpu time spent in the quantum (cycles)
+    uint64 runtime;           // cumulative cpu time (cycles)
+    uint tshare;              // sum of the shares reserved by threads
+    uint64 tpass;             // stride pass of threads without share
+    uint64 vruntime;          // cpu time for fair share policy (cycles)
+    uint weight;              // proportion of EEVDF or EDF client
+    uint64 request;           // cpu time requested at once (cycles)
+    uint64 served;            // cpu time served for the request (cycles)
+    uint64 ve;                // virtual eligible time of EEVDF client
+    uint64 vd;                // virtual deadline of EEVDF client
+    uint dlruntime;           // cpu time of EDF client per period (us)
+    uint dlperiod;            // period of EDF client (us)
+    uint dldeadline;          // deadline from the start of period (us)
+    uint64 dlbudget;          // cpu time left for the job (cycles)
+    uint64 dlabs;             // deadline of the job (TSC)
+    uint64 dlnext;            // start of the next period (TSC)
+    int dllate;               // if non-zero, the job missed its deadline
+    uint dljobs;              // number of jobs started
+    uint dlmiss;              // number of deadlines missed
+    int queued;               // if non-zero, linked in run queue
+    int running;              // number of threads on cpu
+    int gang;                 // if non-zero, threads are co-scheduled
+    uint64 gangend;           // end of the round of the gang (TSC)
+    struct proc *next;        // next process in run queue
+    struct proc *prev;        // previous process in run queue
+  } mlfq;                     // member for scheduler
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,101 @@
+// Round robin scheduling policy.
+// Every process runs for the quantum of the top level in turn.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
+#include "mlfq.h"
+#include "sched.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+
+static void
+rr_append(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.level = 0;
+}
+
+static void
+rr_enqueue(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.queued = 1;
+  this->nqueued++;
+  runlist_append(&this->queue[0], p);
+}
+
+static void
+rr_dequeue(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.queued = 0;
+  this->nqueued--;
+  runlist_remove(&this->queue[0], p);
+}
+
+// Head of the queue.
+static struct proc*
+rr_pick(struct mlfq* this, struct thread** t)
+{
+  struct proc* p;
+
+  while ((p = this->queue[0].head)) {
+    if ((*t = sched_thread(p)))
+      return p;
+    // Threads left runnable state without notifying scheduler.
+    rr_dequeue(this, p);
+  }
+  return 0;
+}
+
+// Give the process waiting longest to the other cpu.
+static struct proc*
+rr_steal(struct mlfq* this, struct mlfq* thief)
+{
+  struct proc* p;
+
+  for (p = this->queue[0].tail; p; p = p->mlfq.prev)
+    if (sched_movable(this, thief, p)) {
+      rr_dequeue(this, p);
+      return p;
+    }
+  return 0;
+}
+
+static int
+rr_tick(struct mlfq* this, struct proc* p, struct thread* t, uint64 used)
+{
+  // When process terminated, queue is cleared by method wait().
+  if (p->state == ZOMBIE || p->killed)
+    return MLFQ_NEXT;
+
+  // Quantum is shared by the threads dispatched in a row.
+  p->mlfq.slice += used;
+  if (p->mlfq.slice < cycles(this->quantum[0]))
+    return MLFQ_KEEP;
+
+  p->mlfq.slice = 0;
+  return MLFQ_NEXT;
+}
+
+static uint64
+rr_remain(struct mlfq* this, struct proc* p)
+{
+  uint64 dur = p->mlfq.slice + (rdtsc() - mycpu()->start);
+  uint64 quantum = cycles(this->quantum[0]);
+  return dur < quantum ? quantum - dur : 0;
+}
+
+struct schedops rr_ops = {
+  .name = "rr",
+  .append = rr_append,
+  .enqueue = rr_enqueue,
+  .dequeue = rr_dequeue,
+  .pick_next = rr_pick,
+  .thread = sched_thread,
+  .steal = rr_steal,
+  .tick = rr_tick,
+  .remain = rr_remain,
+};
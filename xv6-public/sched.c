@@ -0,0 +1,665 @@
+// Run queues of cpus, independent of the scheduling policy.
+// Policy decides the order of processes through the table of operations,
+// see sched.h, and scheduler() in proc.c dispatches the chosen thread.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
+#include "mlfq.h"
+#include "sched.h"
+#include "mmu.h"
+#include "x86.h"
+#include "traps.h"
+#include "proc.h"
+
+#ifndef SCHEDPOLICY
+#define SCHEDPOLICY mlfq_ops
+#endif
+
+struct schedops *schedops = &SCHEDPOLICY;
+
+// Convert microseconds to TSC cycles.
+uint64
+cycles(uint us)
+{
+  return (uint64)(us / TICKUS) * tickcycles
+         + div64((uint64)(us % TICKUS) * tickcycles, TICKUS);
+}
+
+// Link process at the tail of the list.
+void
+runlist_append(struct runlist* q, struct proc* p)
+{
+  runlist_insert(q, 0, p);
+}
+
+// Link process in front of `pos`, at the tail if `pos` is zero.
+void
+runlist_insert(struct runlist* q, struct proc* pos, struct proc* p)
+{
+  p->mlfq.next = pos;
+  p->mlfq.prev = pos ? pos->mlfq.prev : q->tail;
+  if (p->mlfq.prev)
+    p->mlfq.prev->mlfq.next = p;
+  else
+    q->head = p;
+  if (pos)
+    pos->mlfq.prev = p;
+  else
+    q->tail = p;
+}
+
+// Unlink process from the list.
+void
+runlist_remove(struct runlist* q, struct proc* p)
+{
+  if (p->mlfq.prev)
+    p->mlfq.prev->mlfq.next = p->mlfq.next;
+  else
+    q->head = p->mlfq.next;
+  if (p->mlfq.next)
+    p->mlfq.next->mlfq.prev = p->mlfq.prev;
+  else
+    q->tail = p->mlfq.prev;
+
+  p->mlfq.next = 0;
+  p->mlfq.prev = 0;
+}
+
+// Link thread at the tail of the runnable list of its process.
+static void
+sched_link(struct proc* p, struct thread* t)
+{
+  if (t->runnable)
+    return;
+  t->runnable = 1;
+  t->rnext = 0;
+  t->rprev = p->rtail;
+  if (p->rtail)
+    p->rtail->rnext = t;
+  else
+    p->rhead = t;
+  p->rtail = t;
+  p->nrunnable++;
+}
+
+// Unlink thread from the runnable list of its process.
+void
+sched_unlink(struct proc* p, struct thread* t)
+{
+  if (!t->runnable)
+    return;
+  if (t->rprev)
+    t->rprev->rnext = t->rnext;
+  else
+    p->rhead = t->rnext;
+  if (t->rnext)
+    t->rnext->rprev = t->rprev;
+  else
+    p->rtail = t->rprev;
+  t->runnable = 0;
+  t->rnext = 0;
+  t->rprev = 0;
+  p->nrunnable--;
+}
+
+// Get the runnable thread in given process.
+// Threads are picked in round robin order, the one runnable longest first,
+// since dispatched threads rejoin the tail of the list.
+// Thread still switching out from the other cpu is skipped.
+// It returns 0 if nothing runnable.
+struct thread*
+sched_thread(struct proc* p)
+{
+  struct thread *t, *next;
+
+  for (t = p->rhead; t; t = next) {
+    next = t->rnext;
+    if (t->state != RUNNABLE)
+      // Thread left runnable state without notifying scheduler.
+      sched_unlink(p, t);
+    else if (!t->oncpu)
+      return t;
+  }
+  return 0;
+}
+
+// Put process back to the run queue if it has runnable threads.
+// Process stays in the queue while its threads run,
+// so that the other threads can be dispatched to the other cpus.
+static void
+requeue(struct mlfq* this, struct proc* p)
+{
+  if (!p->mlfq.queued && p->nrunnable)
+    schedops->enqueue(this, p);
+}
+
+// Lock two run queues in the order of address for avoiding deadlock.
+void
+sched_lock2(struct mlfq* a, struct mlfq* b)
+{
+  if (a < b) {
+    acquire(&a->lock);
+    acquire(&b->lock);
+  } else {
+    acquire(&b->lock);
+    acquire(&a->lock);
+  }
+}
+
+// Wake up a halted cpu for the process queued in this run queue.
+// The owner cpu is preferred, otherwise an idle cpu allowed to
+// the process steals it.
+// Owner cpu running without tick resumes the tick for the quantum.
+static void
+kick(struct mlfq* this, struct proc* p)
+{
+  struct cpu* c;
+  struct mlfq* rq = this;
+
+  if (!rq->idle && rq->cpu->tickless) {
+    if (rq->cpu == mycpu()) {
+      if (mycpu()->proc)
+        clockarm(sched_timeout(rq, mycpu()->proc));
+    } else {
+      lapicipi(rq->cpu->apicid, T_IRQ0 + IRQ_WAKEUP);
+      this->stat.nipi++;
+    }
+  }
+
+  if (!rq->idle) {
+    for (c = cpus; c < &cpus[ncpu]; ++c)
+      if (c->rq->idle && (p->mlfq.cpus & CPUBIT(c->rq)))
+        break;
+    if (c == &cpus[ncpu])
+      return;
+    rq = c->rq;
+  }
+
+  // Whoever clears the flag sends the IPI,
+  // cpu checks the flag again right before halting.
+  if (xchg(&rq->idle, 0) && rq->cpu != mycpu()) {
+    lapicipi(rq->cpu->apicid, T_IRQ0 + IRQ_WAKEUP);
+    this->stat.nipi++;
+  }
+}
+
+// Ask `n` other cpus to run the runnable threads of the gang process
+// until the end of its round. Idle cpus are asked first, then the ones
+// running MLFQ processes. Reserved classes and the other gangs keep
+// their cpus. Every invitation holds a reference in `mlfq.running`
+// until it is answered, so that the process is not freed meanwhile.
+static void
+invite(struct mlfq* this, struct proc* p, int n)
+{
+  int pass;
+  struct cpu* c;
+  struct proc* cur;
+
+  for (pass = 0; pass < 2 && n > 0; ++pass)
+    for (c = cpus; c < &cpus[ncpu] && n > 0; ++c) {
+      if (c == mycpu() || c->rq->gang || !(p->mlfq.cpus & CPUBIT(c->rq)))
+        continue;
+      // Unlocked peek, the invited cpu checks the round again.
+      cur = c->proc;
+      if (pass == 0 ? cur != 0
+          : cur == 0 || cur == p || cur->mlfq.gang || cur->mlfq.level < 0)
+        continue;
+      if (!__sync_bool_compare_and_swap(&c->rq->gang, 0, p))
+        continue;
+
+      p->mlfq.running++;
+      n--;
+      // Running thread yields for the invitation, see sched_yieldable().
+      xchg(&c->rq->idle, 0);
+      lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+      this->stat.nipi++;
+    }
+}
+
+// Make the thread running on the owner cpu yield,
+// for the process queued in this run queue.
+void
+sched_preempt(struct mlfq* this)
+{
+  this->preempt = 1;
+  if (this->cpu != mycpu()) {
+    lapicipi(this->cpu->apicid, T_IRQ0 + IRQ_WAKEUP);
+    this->stat.nipi++;
+  }
+}
+
+// Halt the idle cpu until an interrupt arrives,
+// instead of spinning on the run queues.
+void
+sched_idle(struct mlfq* this)
+{
+  uint64 tsc;
+
+  cli();
+  if (this->idle) {
+    // Process left for its warm cache may be stolen later,
+    // and throttled one becomes runnable.
+    clockarm(this->retry);
+    tsc = rdtsc();
+    // Interrupt is delivered after hlt begins,
+    // so that IPI sent meanwhile cannot be lost.
+    asm volatile("sti; hlt");
+    tsc = rdtsc() - tsc;
+
+    acquire(&this->lock);
+    this->idlecycles += tsc;
+    release(&this->lock);
+  }
+  this->idle = 0;
+  sti();
+}
+
+// Initialize run queue of the cpu.
+void
+sched_init(struct mlfq* this, struct cpu* c)
+{
+  int i;
+
+  // Microseconds.
+  static const uint quantum[] = { 50000, 100000, 200000 };
+  static const uint expire[] = { 200000, 400000, 2000000 };
+
+  initlock(&this->lock, "runqueue");
+  for (i = 0; i < NMLFQ; ++i) {
+    this->quantum[i] = quantum[i];
+    this->expire[i] = expire[i];
+    this->queue[i].head = 0;
+    this->queue[i].tail = 0;
+  }
+  this->bitmap = 0;
+  this->nqueued = 0;
+  this->cpu = c;
+  this->idle = 0;
+  this->preempt = 0;
+  this->retry = 0;
+  this->gang = 0;
+  this->idlecycles = 0;
+  memset(&this->stat, 0, sizeof(this->stat));
+
+  if (schedops->init)
+    schedops->init(this);
+}
+
+// Lock the run queue which holds given process.
+// Process may migrate to the other queue while waiting the lock,
+// so check it again after acquiring.
+struct mlfq*
+sched_lock(struct proc* p)
+{
+  struct mlfq* rq;
+  for (;;) {
+    rq = p->mlfq.rq;
+    acquire(&rq->lock);
+    if (rq == p->mlfq.rq)
+      return rq;
+    release(&rq->lock);
+  }
+}
+
+// Append new process to the run queue.
+void
+sched_append(struct mlfq* this, struct proc* p)
+{
+  p->mlfq.rq = this;
+  p->mlfq.slice = 0;
+  p->mlfq.runtime = 0;
+  p->mlfq.queued = 0;
+  p->mlfq.running = 0;
+  p->mlfq.gang = 0;
+  p->mlfq.gangend = 0;
+  schedops->append(this, p);
+  requeue(this, p);
+}
+
+// Notify that a thread of given process became runnable.
+void
+sched_ready(struct mlfq* this, struct proc* p, struct thread* t)
+{
+  sched_link(p, t);
+  if (schedops->wake)
+    schedops->wake(this, p, t);
+
+  if (!p->mlfq.queued) {
+    requeue(this, p);
+    kick(this, p);
+  }
+  // Thread woken up in the round of its gang joins the others.
+  if (p->mlfq.gang && rdtsc() < p->mlfq.gangend)
+    invite(this, p, 1);
+}
+
+// Notify that a thread of given process is not runnable anymore.
+void
+sched_unready(struct mlfq* this, struct proc* p, struct thread* t)
+{
+  sched_unlink(p, t);
+  if (p->nrunnable == 0 && p->mlfq.queued)
+    schedops->dequeue(this, p);
+}
+
+// Wait until given thread is switched out from the other cpu.
+void
+sched_offcpu(struct proc* p, struct thread* t)
+{
+  struct mlfq* rq;
+  for (;;) {
+    rq = sched_lock(p);
+    if (!t->oncpu)
+      break;
+    release(&rq->lock);
+  }
+  release(&rq->lock);
+}
+
+// Delete process from the scheduler.
+// Wait until every thread is switched out from the other cpus.
+void
+sched_delete(struct proc* p)
+{
+  struct mlfq* rq;
+
+  for (;;) {
+    rq = sched_lock(p);
+    if (!p->mlfq.running)
+      break;
+    release(&rq->lock);
+  }
+
+  if (p->mlfq.queued)
+    schedops->dequeue(rq, p);
+  if (schedops->remove)
+    schedops->remove(rq, p);
+
+  while (p->rhead)
+    sched_unlink(p, p->rhead);
+  release(&rq->lock);
+}
+
+// Choose the process to run and write its thread to run.
+// Process `p` of the previous run is kept if the policy allowed it
+// and it has something to run on this cpu, unless it is preempted.
+struct proc*
+sched_pick(struct mlfq* this, struct proc* p, struct thread** t)
+{
+  uint64 tsc;
+
+  this->retry = 0;
+  if (p && !this->preempt && p->mlfq.rq == this && (*t = schedops->thread(p)))
+    return p;
+
+  tsc = rdtsc();
+  p = schedops->pick_next(this, t);
+  this->stat.npick++;
+  this->stat.pickcycles += rdtsc() - tsc;
+  return p;
+}
+
+// Take the thread from the run queue before switching to it,
+// process returns to the tail with the other runnable threads.
+void
+sched_dispatch(struct mlfq* this, struct proc* p, struct thread* t)
+{
+  if (p->mlfq.queued)
+    schedops->dequeue(this, p);
+  sched_unlink(p, t);
+  p->mlfq.running++;
+  t->oncpu = 1;
+  requeue(this, p);
+}
+
+// Start the round of the gang process dispatched on this cpu,
+// unless its round is going on. Round lasts for the quantum of
+// the thread on this cpu, which alone is charged for the process.
+void
+sched_gang(struct mlfq* this, struct proc* p)
+{
+  uint64 now = mycpu()->start;
+
+  // Reserved classes run one thread at a time.
+  if (!p->mlfq.gang || p->mlfq.level < 0 || now < p->mlfq.gangend)
+    return;
+  p->mlfq.gangend = now + schedops->remain(this, p);
+  invite(this, p, p->nrunnable);
+}
+
+// Answer the invitation of the gang process, dispatching its
+// runnable thread on this cpu while the process stays in its run queue.
+// It is called holding the lock of this run queue, returns with it held.
+// It returns zero if the round is over or nothing is left to run.
+struct thread*
+sched_follow(struct mlfq* this)
+{
+  struct mlfq* home;
+  struct thread* t = 0;
+  struct proc* p = this->gang;
+
+  this->gang = 0;
+  for (;;) {
+    home = p->mlfq.rq;
+    if (home == this)
+      break;
+    release(&this->lock);
+    sched_lock2(this, home);
+    if (home == p->mlfq.rq)
+      break;
+    release(&home->lock);
+  }
+
+  if (rdtsc() < p->mlfq.gangend && (t = schedops->thread(p))) {
+    sched_unlink(p, t);
+    t->oncpu = 1;
+    this->stat.nfollow++;
+  } else
+    p->mlfq.running--;
+
+  if (home != this)
+    release(&home->lock);
+  return t;
+}
+
+// Thread is switched out after running `used` cycles.
+// Thread following the gang is not charged, see sched_gang().
+// It returns whether the process may keep the cpu.
+int
+sched_done(struct mlfq* rq, struct proc* p, struct thread* t, uint64 used)
+{
+  int keep;
+
+  // Thread is switched out, it can run on the other cpus.
+  t->oncpu = 0;
+  p->mlfq.runtime += used;
+  p->mlfq.lastrun = rdtsc();
+  keep = mycpu()->follow ? MLFQ_NEXT : schedops->tick(rq, p, t, used);
+
+  // Round robin, return to the tail of the run queue
+  // if the thread became runnable while switching out.
+  requeue(rq, p);
+  // Process moved to the other cpu while running.
+  if (rq != mycpu()->rq && !mycpu()->follow && p->mlfq.queued)
+    kick(rq, p);
+
+  // Process may be freed by wait() after this.
+  p->mlfq.running--;
+  return keep;
+}
+
+// Whether the queued process may migrate from the victim to this run queue.
+// Process must be allowed on this cpu. Process switched out recently
+// stays on its cpu for the warm cache, unless the victim is loaded
+// beyond the imbalance threshold. Threads running on the victim
+// have their own working set, so that the others may run in parallel.
+// Gang in its round is not stolen, its threads are invited instead.
+int
+sched_movable(struct mlfq* victim, struct mlfq* this, struct proc* p)
+{
+  if (!(p->mlfq.cpus & CPUBIT(this)))
+    return 0;
+  if (p->mlfq.gang && p->mlfq.running)
+    return 0;
+  if ((int)(victim->nqueued - this->nqueued) >= MIGRATEIMB)
+    return 1;
+  if (!p->mlfq.running && rdtsc() - p->mlfq.lastrun < cycles(MIGRATECOST)) {
+    this->stat.nhot++;
+    sched_retry(this, cycles(MIGRATECOST));
+    return 0;
+  }
+  return 1;
+}
+
+// Queued process becomes runnable in `wait` cycles,
+// idle cpu looks again then instead of waiting for the wakeup.
+void
+sched_retry(struct mlfq* this, uint64 wait)
+{
+  if (this->retry == 0 || wait < this->retry)
+    this->retry = wait ? wait : 1;
+}
+
+// Move process to the other run queue, both locked.
+static void
+migrate(struct mlfq* from, struct mlfq* to, struct proc* p)
+{
+  int queued = p->mlfq.queued;
+
+  if (queued)
+    schedops->dequeue(from, p);
+  p->mlfq.rq = to;
+  to->stat.nmigrate++;
+  if (queued) {
+    schedops->enqueue(to, p);
+    kick(to, p);
+  }
+}
+
+// Steal a queued process from the other busy cpu.
+// It is called by idle cpu holding the lock of its own run queue,
+// returns with the lock held.
+int
+sched_steal(struct mlfq* this)
+{
+  struct cpu* c;
+  struct mlfq* victim;
+  struct proc* p;
+
+  for (c = cpus; c < &cpus[ncpu]; ++c) {
+    victim = c->rq;
+    // Unlocked peek, checked again after locking.
+    if (victim == this || victim->nqueued == 0)
+      continue;
+
+    release(&this->lock);
+    sched_lock2(this, victim);
+    if ((p = schedops->steal(victim, this)) == 0) {
+      release(&victim->lock);
+      continue;
+    }
+
+    p->mlfq.rq = this;
+    schedops->enqueue(this, p);
+    this->stat.nsteal++;
+    this->stat.nmigrate++;
+
+    release(&victim->lock);
+    return 1;
+  }
+  return 0;
+}
+
+// Run queue for the new process allowed on the cpus of the mask,
+// this cpu if allowed, otherwise the one queueing least.
+struct mlfq*
+sched_place(uint mask)
+{
+  struct cpu* c;
+  struct mlfq* best = 0;
+
+  if (mask & CPUBIT(mycpu()->rq))
+    return mycpu()->rq;
+  // Unlocked peek, placement is a hint.
+  for (c = cpus; c < &cpus[ncpu]; ++c)
+    if ((mask & CPUBIT(c->rq)) && (!best || c->rq->nqueued < best->nqueued))
+      best = c->rq;
+  return best;
+}
+
+// Restrict process to the cpus of the mask, moving it to one of them
+// unless its run queue is allowed. Process reserving a share stays on
+// the cpu of the reservation, it fails if that cpu is not allowed.
+// Thread running on the other cpu moves when it is switched out.
+int
+sched_migrate(struct proc* p, uint mask)
+{
+  struct mlfq* home;
+  struct mlfq* target;
+
+  for (;;) {
+    home = sched_lock(p);
+    if (mask & CPUBIT(home)) {
+      p->mlfq.cpus = mask;
+      release(&home->lock);
+      return 0;
+    }
+    if (p->mlfq.level < 0) {
+      release(&home->lock);
+      return -1;
+    }
+
+    target = sched_place(mask);
+    release(&home->lock);
+    sched_lock2(home, target);
+    if (p->mlfq.rq == home)
+      break;
+    // Process was stolen meanwhile, try again.
+    release(&target->lock);
+    release(&home->lock);
+  }
+
+  p->mlfq.cpus = mask;
+  migrate(home, target, p);
+  release(&target->lock);
+  release(&home->lock);
+  return 0;
+}
+
+// Check whether interrupt yield the process to scheduling CPU or not.
+// Thread following the gang runs until the end of the round,
+// and the other threads yield when the cpu is invited to a gang.
+int
+sched_yieldable(struct mlfq* this, struct proc* p)
+{
+  if (mycpu()->follow)
+    return rdtsc() >= p->mlfq.gangend;
+  if (mycpu()->rq->gang)
+    return 1;
+  return schedops->remain(this, p) == 0;
+}
+
+// Cycles until the timer interrupt of the thread running on this cpu,
+// zero if it runs without competition and needs no interrupt.
+// Interrupt comes at least every tick for switching threads of the process,
+// except for the thread following the gang until the end of the round.
+uint64
+sched_timeout(struct mlfq* this, struct proc* p)
+{
+  uint64 left;
+  uint64 now;
+  uint64 tick = cycles(TICKUS);
+
+  if (mycpu()->follow) {
+    now = rdtsc();
+    return now < p->mlfq.gangend ? p->mlfq.gangend - now : 1;
+  }
+  if (this->nqueued == 0)
+    return 0;
+  left = schedops->remain(this, p);
+  return left == 0 ? 1 : left < tick ? left : tick;
+}
@@ -0,0 +1,38 @@
+// Scheduling policy, operations on the run queue of a cpu.
+// Every operation is called with the lock of the run queue held,
+// except remain called by the interrupt of the running thread.
+// The policy is chosen at build time, see SCHEDPOLICY in Makefile.
+struct schedops {
+  char *name;
+  // Initialize policy state of the run queue, optional.
+  void (*init)(struct mlfq*);
+  // Initialize policy state of the new process.
+  void (*append)(struct mlfq*, struct proc*);
+  // Link runnable process to the run queue and set `mlfq.queued`.
+  void (*enqueue)(struct mlfq*, struct proc*);
+  // Unlink process from the run queue and clear `mlfq.queued`.
+  void (*dequeue)(struct mlfq*, struct proc*);
+  // Notify that a thread of the process became runnable, optional.
+  void (*wake)(struct mlfq*, struct proc*, struct thread*);
+  // Choose the next process and write its thread to run,
+  // returns 0 if nothing runnable.
+  struct proc* (*pick_next)(struct mlfq*, struct thread**);
+  // Choose the thread to run in the process, 0 if nothing runnable.
+  struct thread* (*thread)(struct proc*);
+  // Unlink a queued process which may migrate to the run queue
+  // of the second argument, see sched_movable(), returns 0 if nothing.
+  struct proc* (*steal)(struct mlfq*, struct mlfq*);
+  // Charge the thread which ran `used` cycles, returns MLFQ_KEEP
+  // to run the process again, MLFQ_NEXT to pick the next one.
+  int (*tick)(struct mlfq*, struct proc*, struct thread*, uint64);
+  // Cycles left in the quantum of the running thread,
+  // zero if it should yield the cpu.
+  uint64 (*remain)(struct mlfq*, struct proc*);
+  // Release policy state of the exiting process, optional.
+  void (*remove)(struct mlfq*, struct proc*);
+};
+
+extern struct schedops *schedops;
+extern struct schedops mlfq_ops;
+extern struct schedops rr_ops;
+extern struct schedops fair_ops;
@@ -0,0 +1,98 @@
+/**
+ *  This program measures the latency of scheduling decision
+ * with given number of live processes.
+ *  Children block on the pipe, so that they are alive but not runnable,
+ * while the cpus pass through the scheduler or halt.
+ *  Same measurement is repeated with children joining the stride scheduler,
+ * and with children sleeping on timers, which should not be woken up
+ * by the ticks before their deadline.
+ *  Idle time of each cpu shows how long it halted instead of spinning.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+#include "x86.h"
+
+#define PERIOD          100         // (ticks)
+#define NLIVE           3           // init, sh and this process
+
+void
+bench(int nlive, int share, int timed)
+{
+  int i, n, pid;
+  int pids[NPROC];
+  int fd[2];
+  char c;
+  uint npick;
+  struct schedstat before, after;
+  struct runtime rt;
+
+  if (pipe(fd) < 0) {
+    printf(1, "pipe failure\n");
+    exit();
+  }
+
+  // Fork children until reaching the number of live processes
+  // or the process table is full.
+  for (n = NLIVE; n < nlive; ++n) {
+    if ((pid = fork()) < 0)
+      break;
+
+    if (pid == 0) {
+      if (share > 0 && set_cpu_share(share) < 0)
+        printf(1, "cannot set cpu share\n");
+      close(fd[1]);
+      if (timed)
+        sleep(10 * PERIOD);
+      else
+        read(fd[0], &c, 1);
+      exit();
+    }
+    pids[n] = pid;
+  }
+  close(fd[0]);
+
+  getschedstat(&before);
+  for (i = 0; i < PERIOD; ++i)
+    sleep(1);
+  getschedstat(&after);
+
+  // Wake up children by closing the write end,
+  // or by killing sleeping ones.
+  close(fd[1]);
+  for (i = NLIVE; i < n; ++i) {
+    if (timed)
+      kill(pids[i]);
+    wait();
+  }
+
+  npick = after.npick - before.npick;
+  printf(1, "%s%s live: %d, picks: %d, cycles/pick: %d\n",
+         share > 0 ? "stride" : "mlfq", timed ? " timed" : "", n, npick,
+         div64(after.pickcycles - before.pickcycles, npick));
+  printf(1, "  wakeups: %d, inspected: %d, woken: %d\n",
+         after.nwakeup - before.nwakeup, after.ninspect - before.ninspect,
+         after.nwoken - before.nwoken);
+
+  // Idle time of each cpu, in ticks of the period.
+  getruntime(&rt);
+  printf(1, "  ipis: %d, timer irqs: %d, idle ticks:",
+         after.nipi - before.nipi, after.ntimer - before.ntimer);
+  for (i = 0; i < after.ncpu; ++i)
+    printf(1, " %d", div64(after.idle[i] - before.idle[i], rt.tickcycles));
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench(8, 0, 0);
+  bench(64, 0, 0);
+  bench(8, 1, 0);
+  bench(64, 1, 0);
+  bench(64, 0, 1);
+  exit();
+}
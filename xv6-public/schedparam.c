@@ -0,0 +1,53 @@
+/**
+ *  This program prints the parameters of MLFQ scheduler,
+ * or replaces them with given values in microseconds:
+ *   schedparam boost quantum0 .. quantumN expire0 .. expireN
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+void
+print(struct schedparam *param)
+{
+  int i;
+
+  printf(1, "boost: %d\n", param->boost);
+  for (i = 0; i < NMLFQ; ++i)
+    printf(1, "level %d: quantum %d, expire %d\n",
+           i, param->quantum[i], param->expire[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  struct schedparam param;
+
+  if (argc == 1) {
+    getschedparam(&param);
+    print(&param);
+    exit();
+  }
+
+  if (argc != 2 + 2 * NMLFQ) {
+    printf(2, "usage: schedparam boost quantum0..%d expire0..%d\n",
+           NMLFQ - 1, NMLFQ - 1);
+    exit();
+  }
+
+  param.boost = atoi(argv[1]);
+  for (i = 0; i < NMLFQ; ++i) {
+    param.quantum[i] = atoi(argv[2 + i]);
+    param.expire[i] = atoi(argv[2 + NMLFQ + i]);
+  }
+  if (setschedparam(&param) < 0) {
+    printf(2, "schedparam: invalid parameters\n");
+    exit();
+  }
+  print(&param);
+  exit();
+}
@@ -0,0 +1,60 @@
+// Scheduler statistics, see getschedstat().
+struct schedstat {
+  uint npick;           // number of scheduling decisions
+  uint64 pickcycles;    // TSC cycles spent on scheduling decisions
+  uint nsteal;          // number of processes stolen by idle cpus
+  uint nmigrate;        // processes moved to the run queue of the other cpu
+  uint nhot;            // steals declined to keep the cache warm
+  uint nfollow;         // threads dispatched to follow their gang
+  uint nmiss;           // deadlines missed by EDF clients
+  uint nwakeup;         // number of wakeups
+  uint ninspect;        // sleeping threads inspected by wakeups
+  uint nwoken;          // sleeping threads woken by wakeups
+  uint nipi;            // number of IPIs sent to the other cpus
+  uint ntimer;          // number of timer interrupts
+  uint ntrlost;         // trace events dropped by full rings
+  uint ncpu;            // number of cpus
+  uint64 idle[NCPU];    // TSC cycles halted, per cpu
+};
+
+// Tunable parameters of MLFQ scheduler, see setschedparam().
+struct schedparam {
+  uint boost;           // priority boost period (microseconds)
+  uint quantum[NMLFQ];  // round robin time quantum of each level (us)
+  uint expire[NMLFQ];   // allotment before demotion of each level (us)
+};
+
+// Reservation of EDF process and its jobs, see getdeadline().
+struct dlstat {
+  uint runtime;         // cpu time reserved per period (us)
+  uint period;          // period (us)
+  uint deadline;        // deadline from the start of period (us)
+  uint njob;            // jobs started, one per period run
+  uint nmiss;           // jobs not done by their deadline
+};
+
+// Cpu time consumed by process, see getruntime().
+struct runtime {
+  uint64 cycles;        // TSC cycles spent running
+  uint tickcycles;      // TSC cycles per timer tick
+};
+
+// Scheduler event recorded in the trace ring of a cpu, see gettrace().
+struct traceev {
+  uint64 tsc;           // TSC of the event
+  int pid;              // process of the event, 0 for the run queue
+  int tid;              // thread of the event, 0 for the run queue
+  uchar type;           // one of TR_*
+  uchar cpu;            // cpu recording the event
+  char level;           // MLFQ level of the thread, or class of the process
+};
+
+#define TR_DISPATCH     1   // thread is switched in
+#define TR_PREEMPT      2   // interrupt made the thread yield
+#define TR_YIELD        3   // thread yielded by itself
+#define TR_SLEEP        4   // thread went to sleep
+#define TR_WAKEUP       5   // sleeping thread became runnable
+#define TR_DEMOTE       6   // thread moved down to the level
+#define TR_BOOST        7   // run queue boosted to the top level
+#define TR_SWITCH       8   // thread yielded to the other thread of process
+#define NTRTYPE         9
@@ -0,0 +1,241 @@
+/**
+ *  This program summarizes the scheduler event trace, see settrace().
+ *  It runs the given command, or cpu bound and interactive children,
+ * while a thread drains the trace rings of the cpus every tick.
+ *  Run queue latency is the time from the thread becoming runnable,
+ * by a wakeup or a yield, to its dispatch. Time per level is the time
+ * from the dispatch to the thread leaving the cpu, by the level of
+ * the thread at the dispatch.
+ *
+ *  usage: schedtrace [command [args...]]
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+#include "x86.h"
+
+#define NEVENT          256         // events drained at once
+#define NSLOT           256         // threads tracked, by tid
+#define NLEVEL          (NMLFQ + 3) // EDF, EEVDF, stride and MLFQ levels
+#define NWORK           4           // children of the default workload
+#define PERIOD          200         // (ticks)
+#define BURST           100000      // iterations of interactive child
+
+static const char *names[NTRTYPE] = {
+  [TR_DISPATCH] "dispatch",
+  [TR_PREEMPT]  "preempt",
+  [TR_YIELD]    "yield",
+  [TR_SLEEP]    "sleep",
+  [TR_WAKEUP]   "wakeup",
+  [TR_DEMOTE]   "demote",
+  [TR_BOOST]    "boost",
+  [TR_SWITCH]   "switch",
+};
+
+static const char *classes[3] = { "edf", "eevdf", "stride" };
+
+struct traceev buf[NEVENT];
+
+// Thread becoming runnable, by tid modulo NSLOT.
+// Colliding threads only lose their samples.
+struct {
+  int tid;
+  uint64 ready;
+} slots[NSLOT];
+
+// Thread dispatched on each cpu.
+struct {
+  int tid;
+  int level;
+  uint64 start;
+} oncpu[NCPU];
+
+uint count[NTRTYPE];
+uint64 leveltime[NLEVEL];
+uint nlat;
+uint64 latsum, latmax;
+volatile int done;
+
+// Rings are drained in order per cpu, merge them by TSC.
+void
+sort(struct traceev *ev, int n)
+{
+  int i, j;
+  struct traceev key;
+
+  for (i = 1; i < n; ++i) {
+    key = ev[i];
+    for (j = i; j > 0 && ev[j - 1].tsc > key.tsc; --j)
+      ev[j] = ev[j - 1];
+    ev[j] = key;
+  }
+}
+
+// Thread leaves the cpu, charging its level.
+void
+offcpu(struct traceev *ev)
+{
+  int level;
+
+  if (oncpu[ev->cpu].tid != ev->tid || ev->tsc < oncpu[ev->cpu].start)
+    return;
+  level = oncpu[ev->cpu].level + 3;
+  if (level >= 0 && level < NLEVEL)
+    leveltime[level] += ev->tsc - oncpu[ev->cpu].start;
+  oncpu[ev->cpu].tid = 0;
+}
+
+void
+account(struct traceev *ev)
+{
+  uint64 lat;
+  int idx = ev->tid % NSLOT;
+
+  if (ev->type < NTRTYPE)
+    count[ev->type]++;
+  if (ev->tid == 0 || ev->cpu >= NCPU)
+    return;
+
+  switch (ev->type) {
+  case TR_DISPATCH:
+    if (slots[idx].tid == ev->tid && slots[idx].ready
+        && ev->tsc > slots[idx].ready) {
+      lat = ev->tsc - slots[idx].ready;
+      nlat++;
+      latsum += lat;
+      if (lat > latmax)
+        latmax = lat;
+    }
+    slots[idx].ready = 0;
+    oncpu[ev->cpu].tid = ev->tid;
+    oncpu[ev->cpu].level = ev->level;
+    oncpu[ev->cpu].start = ev->tsc;
+    break;
+  case TR_PREEMPT:
+  case TR_YIELD:
+  case TR_SWITCH:
+    offcpu(ev);
+    slots[idx].tid = ev->tid;
+    slots[idx].ready = ev->tsc;
+    break;
+  case TR_SLEEP:
+    offcpu(ev);
+    break;
+  case TR_WAKEUP:
+    slots[idx].tid = ev->tid;
+    slots[idx].ready = ev->tsc;
+    break;
+  }
+}
+
+void
+collect(void)
+{
+  int i, n;
+
+  do {
+    n = gettrace(buf, NEVENT);
+    sort(buf, n);
+    for (i = 0; i < n; ++i)
+      account(&buf[i]);
+  } while (n == NEVENT);
+}
+
+// Drain the rings every tick until the traced run is done.
+void*
+drain(void *arg)
+{
+  while (!done) {
+    collect();
+    sleep(1);
+  }
+  collect();
+  thread_exit(0);
+  return 0;
+}
+
+// Cpu bound children, and interactive ones computing briefly per tick.
+void
+workload(void)
+{
+  int i, j;
+  volatile int k;
+
+  for (i = 0; i < NWORK; ++i) {
+    if (fork() == 0) {
+      if (i % 2)
+        for (j = 0; j < PERIOD / 2; ++j) {
+          for (k = 0; k < BURST; ++k)
+            ;
+          sleep(1);
+        }
+      else
+        work(PERIOD / 2);
+      exit();
+    }
+  }
+  for (i = 0; i < NWORK; ++i)
+    wait();
+}
+
+void
+report(struct schedstat *before, struct schedstat *after)
+{
+  int i;
+
+  printf(1, "events:");
+  for (i = 1; i < NTRTYPE; ++i)
+    printf(1, " %s %d", names[i], count[i]);
+  printf(1, ", lost %d\n", after->ntrlost - before->ntrlost);
+
+  printf(1, "run queue latency: samples %d, avg %d us, max %d us\n",
+         nlat, nlat ? cycles2us(div64(latsum, nlat)) : 0, cycles2us(latmax));
+
+  printf(1, "time per level (ms):");
+  for (i = 0; i < NLEVEL; ++i) {
+    if (i < 3)
+      printf(1, " %s %d", classes[i], cycles2us(leveltime[i]) / 1000);
+    else
+      printf(1, " L%d %d", i - 3, cycles2us(leveltime[i]) / 1000);
+  }
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+  void *retval;
+  thread_t drainer;
+  struct schedstat before, after;
+
+  getschedstat(&before);
+  settrace(1);
+  if (thread_create(&drainer, drain, 0) != 0) {
+    printf(1, "thread_create failure\n");
+    settrace(0);
+    exit();
+  }
+
+  if (argc > 1) {
+    if ((pid = fork()) == 0) {
+      exec(argv[1], argv + 1);
+      printf(1, "exec %s failed\n", argv[1]);
+      exit();
+    }
+    if (pid > 0)
+      wait();
+  } else
+    workload();
+
+  done = 1;
+  thread_join(drainer, &retval);
+  settrace(0);
+  getschedstat(&after);
+
+  report(&before, &after);
+  exit();
+}
@@ -0,0 +1,59 @@
+// Slab allocator of fixed size kernel objects.
+// A page from kalloc() is carved into objects when the cache is empty,
+// freed objects return to the free list of the cache for the next
+// allocation. Pages are never returned, so that the objects of a cache
+// stay valid memory while the cache is in use.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+void
+slabinit(struct slab *s, char *name, uint size)
+{
+  initlock(&s->lock, name);
+  s->name = name;
+  s->size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  s->free = 0;
+  s->npage = 0;
+  if (s->size > PGSIZE)
+    panic("slabinit");
+}
+
+// Allocate a zeroed object, or return zero if out of memory.
+void*
+slaballoc(struct slab *s)
+{
+  char *page, *obj;
+
+  acquire(&s->lock);
+  if (s->free == 0) {
+    if ((page = kalloc()) == 0) {
+      release(&s->lock);
+      return 0;
+    }
+    s->npage++;
+    for (obj = page; obj + s->size <= page + PGSIZE; obj += s->size) {
+      *(void**)obj = s->free;
+      s->free = obj;
+    }
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  release(&s->lock);
+
+  memset(obj, 0, s->size);
+  return obj;
+}
+
+void
+slabfree(struct slab *s, void *obj)
+{
+  acquire(&s->lock);
+  *(void**)obj = s->free;
+  s->free = obj;
+  release(&s->lock);
+}
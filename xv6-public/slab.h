@@ -0,0 +1,8 @@
+// Cache of fixed size objects carved from the pages of kalloc().
+struct slab {
+  struct spinlock lock;   // protects the free list
+  char *name;             // name of the cache, for debugging
+  uint size;              // object size in bytes
+  void *free;             // free objects, linked through the first word
+  uint npage;             // pages carved so far
+};
@@ -0,0 +1,133 @@
+/**
+ *  This program measures the parallel mergesort by the work-stealing
+ * runtime, see utask.c.
+ *  Each half is sorted by a spawned task down to a grain, and merged
+ * by the spawner after the sync. The elapsed ticks with 1 worker up
+ * to the number of cpus are compared, reporting the speedup over the
+ * single worker.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+#define N               (1 << 18)   // elements to sort
+#define GRAIN           2048        // elements sorted by a leaf task
+
+struct range {
+  uint *a;
+  uint *tmp;
+  int lo, hi;
+};
+
+uint *array;
+uint *tmp;
+
+void
+merge(uint *a, uint *tmp, int lo, int mid, int hi)
+{
+  int i = lo, j = mid, k = lo;
+
+  while (i < mid && j < hi)
+    tmp[k++] = a[i] <= a[j] ? a[i++] : a[j++];
+  while (i < mid)
+    tmp[k++] = a[i++];
+  while (j < hi)
+    tmp[k++] = a[j++];
+  memmove(a + lo, tmp + lo, (hi - lo) * sizeof(uint));
+}
+
+void
+serialsort(uint *a, uint *tmp, int lo, int hi)
+{
+  int mid;
+
+  if (hi - lo < 2)
+    return;
+  mid = lo + (hi - lo) / 2;
+  serialsort(a, tmp, lo, mid);
+  serialsort(a, tmp, mid, hi);
+  merge(a, tmp, lo, mid, hi);
+}
+
+void
+sort(void *arg)
+{
+  int mid;
+  struct range *r = arg;
+  struct range left, right;
+  task_t t;
+
+  if (r->hi - r->lo <= GRAIN) {
+    serialsort(r->a, r->tmp, r->lo, r->hi);
+    return;
+  }
+
+  mid = r->lo + (r->hi - r->lo) / 2;
+  left = right = *r;
+  left.hi = right.lo = mid;
+  task_spawn(&t, sort, &left);
+  sort(&right);
+  task_sync(&t);
+  merge(r->a, r->tmp, r->lo, mid, r->hi);
+}
+
+// Sort random elements with `n` workers, returning the elapsed ticks.
+uint
+bench(int n)
+{
+  int i;
+  uint ticks, seed = 1;
+  struct range r;
+
+  for (i = 0; i < N; ++i) {
+    seed = seed * 1103515245 + 12345;
+    array[i] = seed;
+  }
+
+  if (task_init(n) < 0) {
+    printf(1, "task_init failure\n");
+    exit();
+  }
+  ticks = uptime_fast();
+  r.a = array;
+  r.tmp = tmp;
+  r.lo = 0;
+  r.hi = N;
+  sort(&r);
+  ticks = uptime_fast() - ticks;
+  task_exit();
+
+  for (i = 1; i < N; ++i)
+    if (array[i - 1] > array[i]) {
+      printf(1, "not sorted with %d workers\n", n);
+      break;
+    }
+  return ticks ? ticks : 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+  uint base, ticks;
+  struct schedstat st;
+
+  if ((array = malloc(N * sizeof(uint))) == 0
+      || (tmp = malloc(N * sizeof(uint))) == 0) {
+    printf(1, "malloc failure\n");
+    exit();
+  }
+
+  getschedstat(&st);
+  for (n = 1; n <= st.ncpu; ++n) {
+    ticks = bench(n);
+    if (n == 1)
+      base = ticks;
+    printf(1, "workers: %d, ticks: %d, speedup x100: %d\n",
+           n, ticks, base * 100 / ticks);
+  }
+  exit();
+}
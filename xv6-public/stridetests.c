@@ -1,16 +1,37 @@
 /**
  *  This program requests portion of CPU resources with given parameter
- * value by calling set_cpu_share() system call.
+ * value by calling set_cpu_fraction() system call.
+ *  Percentage may have a fraction such as 12.5,
+ * it is requested in hundredths of a percent.
  *  After that, periodically increases cnt values until its LIFETIME.
  */
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "param.h"
+#include "schedstat.h"
 
 #define LIFETIME        1000        // (ticks)
 #define COUNT_PERIOD    1000000     // (iteration)
 
+// Parse percentage in hundredths of a percent,
+// digits after the second decimal place are ignored.
+int
+parseshare(char *s)
+{
+  int n = 0, scale = 100;
+
+  for (; '0' <= *s && *s <= '9'; ++s)
+    n = n * 10 + *s - '0';
+  if (*s == '.')
+    for (++s; '0' <= *s && *s <= '9' && scale > 1; ++s) {
+      scale /= 10;
+      n = n * 10 + *s - '0';
+    }
+  return n * scale;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -19,22 +40,24 @@ main(int argc, char *argv[])
   int cpu_share;
   uint start_tick;
   uint curr_tick;
+  uint cpu_tick;
+  struct runtime rt;
 
   if (argc < 2) {
     printf(1, "usage: sched_test_stride cpu_share(%)\n");
     exit();
   }
 
-  cpu_share = atoi(argv[1]);
+  cpu_share = parseshare(argv[1]);
 
   // Register this process to the Stride scheduler
-  if (set_cpu_share(cpu_share) < 0) {
+  if (set_cpu_fraction(cpu_share, 100 * 100) < 0) {
     printf(1, "cannot set cpu share\n");
     exit();
   }
 
   // Get start time
-  start_tick = uptime();
+  start_tick = uptime_fast();
 
   i = 0;
   while (1) {
@@ -47,11 +70,19 @@ main(int argc, char *argv[])
       cnt++;
 
       // Get current time
-      curr_tick = uptime();
+      curr_tick = uptime_fast();
 
       if (curr_tick - start_tick > LIFETIME) {
+        // Cpu time actually consumed, in ticks.
+        getruntime(&rt);
+        cpu_tick = 0;
+        if (rt.tickcycles >> 8)
+          cpu_tick = (uint)(rt.cycles >> 8) / (rt.tickcycles >> 8);
+
         // Terminate process
-        printf(1, "STRIDE(%d%%), cnt: %d\n", cpu_share, cnt);
+        printf(1, "STRIDE(%d.%d%d%%), cnt: %d, cpu ticks: %d\n",
+               cpu_share / 100, cpu_share / 10 % 10, cpu_share % 10,
+               cnt, cpu_tick);
         break;
       }
       i = 0;
@@ -0,0 +1,107 @@
+/**
+ *  This program measures the parallel sum over an array by the
+ * work-stealing runtime, see utask.c.
+ *  The range is split in halves by spawned tasks down to a grain,
+ * and the elapsed ticks with 1 worker up to the number of cpus are
+ * compared, reporting the speedup over the single worker.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+#define N               (1 << 20)   // elements of the array
+#define GRAIN           4096        // elements summed by a leaf task
+#define NREP            8           // passes over the array
+
+struct range {
+  uint *a;
+  int lo, hi;
+  uint sum;
+};
+
+uint *array;
+
+void
+sum(void *arg)
+{
+  int i, mid;
+  uint s = 0;
+  struct range *r = arg;
+  struct range left, right;
+  task_t t;
+
+  if (r->hi - r->lo <= GRAIN) {
+    for (i = r->lo; i < r->hi; ++i)
+      s += (r->a[i] * r->a[i]) ^ (r->a[i] >> 3);
+    r->sum = s;
+    return;
+  }
+
+  mid = r->lo + (r->hi - r->lo) / 2;
+  left.a = right.a = r->a;
+  left.lo = r->lo;
+  left.hi = right.lo = mid;
+  right.hi = r->hi;
+  task_spawn(&t, sum, &left);
+  sum(&right);
+  task_sync(&t);
+  r->sum = left.sum + right.sum;
+}
+
+// Sum the array with `n` workers, returning the elapsed ticks.
+uint
+bench(int n, uint *result)
+{
+  int i;
+  uint ticks;
+  struct range r;
+
+  if (task_init(n) < 0) {
+    printf(1, "task_init failure\n");
+    exit();
+  }
+  ticks = uptime_fast();
+  *result = 0;
+  for (i = 0; i < NREP; ++i) {
+    r.a = array;
+    r.lo = 0;
+    r.hi = N;
+    sum(&r);
+    *result += r.sum;
+  }
+  ticks = uptime_fast() - ticks;
+  task_exit();
+  return ticks ? ticks : 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+  uint base, ticks, expect, result;
+  struct schedstat st;
+
+  if ((array = malloc(N * sizeof(uint))) == 0) {
+    printf(1, "malloc failure\n");
+    exit();
+  }
+  for (i = 0; i < N; ++i)
+    array[i] = i * 2654435761u;
+
+  getschedstat(&st);
+  for (n = 1; n <= st.ncpu; ++n) {
+    ticks = bench(n, &result);
+    if (n == 1) {
+      base = ticks;
+      expect = result;
+    }
+    printf(1, "workers: %d, ticks: %d, speedup x100: %d\n",
+           n, ticks, base * 100 / ticks);
+    if (result != expect)
+      printf(1, "sum mismatch with %d workers\n", n);
+  }
+  exit();
+}
@@ -49,8 +49,7 @@ fetchstr(uint addr, char **pp)
 int
 argint(int n, int *ip)
 {
-  struct proc* p = myproc();
-  return fetchint((p->threads[p->tidx].tf->esp) + 4 + 4*n, ip);
+  return fetchint((mythread()->tf->esp) + 4 + 4*n, ip);
 }
 
 // Fetch the nth word-sized system call argument as a pointer
@@ -112,6 +111,28 @@ extern int sys_set_cpu_share(void);
 extern int sys_thread_create(void);
 extern int sys_thread_exit(void);
 extern int sys_thread_join(void);
+extern int sys_getschedstat(void);
+extern int sys_getruntime(void);
+extern int sys_thread_getlev(void);
+extern int sys_thread_set_cpu_share(void);
+extern int sys_getschedparam(void);
+extern int sys_setschedparam(void);
+extern int sys_set_latency(void);
+extern int sys_set_cpu_fraction(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_getaffinity(void);
+extern int sys_thread_setaffinity(void);
+extern int sys_thread_getaffinity(void);
+extern int sys_set_deadline(void);
+extern int sys_getdeadline(void);
+extern int sys_set_gang(void);
+extern int sys_settrace(void);
+extern int sys_gettrace(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_thread_join_any(void);
+extern int sys_thread_kill(void);
+extern int sys_settls(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -143,6 +164,28 @@ static int (*syscalls[])(void) = {
 [SYS_thread_join]     sys_thread_join,
 [SYS_pwrite]  sys_pwrite,
 [SYS_pread]   sys_pread,
+[SYS_getschedstat]    sys_getschedstat,
+[SYS_getruntime]      sys_getruntime,
+[SYS_thread_getlev]   sys_thread_getlev,
+[SYS_thread_set_cpu_share]    sys_thread_set_cpu_share,
+[SYS_getschedparam]   sys_getschedparam,
+[SYS_setschedparam]   sys_setschedparam,
+[SYS_set_latency]     sys_set_latency,
+[SYS_set_cpu_fraction]    sys_set_cpu_fraction,
+[SYS_sched_setaffinity]   sys_sched_setaffinity,
+[SYS_sched_getaffinity]   sys_sched_getaffinity,
+[SYS_thread_setaffinity]  sys_thread_setaffinity,
+[SYS_thread_getaffinity]  sys_thread_getaffinity,
+[SYS_set_deadline]    sys_set_deadline,
+[SYS_getdeadline]     sys_getdeadline,
+[SYS_set_gang]        sys_set_gang,
+[SYS_settrace]     sys_settrace,
+[SYS_gettrace]     sys_gettrace,
+[SYS_futex_wait]   sys_futex_wait,
+[SYS_futex_wake]   sys_futex_wake,
+[SYS_thread_join_any] sys_thread_join_any,
+[SYS_thread_kill]  sys_thread_kill,
+[SYS_settls]       sys_settls,
 };
 
 void
@@ -150,7 +193,7 @@ syscall(void)
 {
   int num;
   struct proc *curproc = myproc();
-  struct thread *curthread = &curproc->threads[curproc->tidx];
+  struct thread *curthread = mythread();
 
   num = curthread->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
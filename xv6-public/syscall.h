@@ -28,3 +28,25 @@
 #define SYS_thread_join     27
 #define SYS_pwrite 28
 #define SYS_pread  29
+#define SYS_getschedstat    30
+#define SYS_getruntime      31
+#define SYS_thread_getlev   32
+#define SYS_thread_set_cpu_share    33
+#define SYS_getschedparam   34
+#define SYS_setschedparam   35
+#define SYS_set_latency     36
+#define SYS_set_cpu_fraction    37
+#define SYS_sched_setaffinity   38
+#define SYS_sched_getaffinity   39
+#define SYS_thread_setaffinity  40
+#define SYS_thread_getaffinity  41
+#define SYS_set_deadline    42
+#define SYS_getdeadline     43
+#define SYS_set_gang        44
+#define SYS_settrace        45
+#define SYS_gettrace        46
+#define SYS_futex_wait      47
+#define SYS_futex_wake      48
+#define SYS_thread_join_any 49
+#define SYS_thread_kill     50
+#define SYS_settls          51
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "schedstat.h"
 
 int
 sys_fork(void)
@@ -62,16 +63,16 @@ sys_sleep(void)
   int n;
   uint ticks0;
 
-  if(argint(0, &n) < 0)
+  if(argint(0, &n) < 0 || n < 0)
     return -1;
   acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
+  ticks0 = readticks();
+  while(readticks() - ticks0 < n){
+    if(killed()){
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleepuntil(&ticks, &tickslock, ticks0 + n);
   }
   release(&tickslock);
   return 0;
@@ -82,17 +83,13 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return readticks();
 }
 
 int
 sys_yield(void)
 {
+  TRACE(TR_YIELD, myproc(), mythread());
   yield();
   return 0;
 }
@@ -116,6 +113,178 @@ sys_set_cpu_share(void)
   return set_cpu_share(n);
 }
 
+// move process form MLFQ scheduler to stride scheduler
+// with given fraction of cpu.
+int
+sys_set_cpu_fraction(void)
+{
+  int num, den;
+  if (argint(0, &num) < 0 || argint(1, &den) < 0)
+    return -1;
+
+  return set_cpu_fraction(num, den);
+}
+
+// move process to EEVDF scheduler with given cpu usage and slice.
+int
+sys_set_latency(void)
+{
+  int n, slice;
+  if (argint(0, &n) < 0 || argint(1, &slice) < 0)
+    return -1;
+
+  return set_latency(n, slice);
+}
+
+// move process to EDF scheduler with given runtime, period and deadline.
+int
+sys_set_deadline(void)
+{
+  int runtime, period, deadline;
+  if (argint(0, &runtime) < 0 || argint(1, &period) < 0
+      || argint(2, &deadline) < 0)
+    return -1;
+
+  return set_deadline(runtime, period, deadline);
+}
+
+// copy reservation of the EDF process and its deadline misses.
+int
+sys_getdeadline(void)
+{
+  struct dlstat *st;
+  if (argptr(0, (char**)&st, sizeof(*st)) < 0)
+    return -1;
+
+  return getdeadline(st);
+}
+
+// co-schedule runnable threads of the process if enabled.
+int
+sys_set_gang(void)
+{
+  int on;
+  if (argint(0, &on) < 0)
+    return -1;
+
+  return set_gang(on);
+}
+
+// enable scheduler event trace if on is non-zero.
+int
+sys_settrace(void)
+{
+  int on;
+  if (argint(0, &on) < 0)
+    return -1;
+
+  return settrace(on);
+}
+
+// drain up to n traced events into the buffer.
+int
+sys_gettrace(void)
+{
+  int n;
+  struct traceev *buf;
+  if (argint(1, &n) < 0 || n < 0 || n > myproc()->sz / sizeof(*buf)
+      || argptr(0, (char**)&buf, n * sizeof(*buf)) < 0)
+    return -1;
+
+  return gettrace(buf, n);
+}
+
+// sleep on the futex word at addr if it holds expected, up to timeout ticks.
+int
+sys_futex_wait(void)
+{
+  int expected, timeout;
+  uint *addr;
+  if (argptr(0, (char**)&addr, sizeof(*addr)) < 0
+      || argint(1, &expected) < 0 || argint(2, &timeout) < 0)
+    return -1;
+
+  return futex_wait(addr, expected, timeout);
+}
+
+// wake up to n threads waiting on the futex word at addr.
+int
+sys_futex_wake(void)
+{
+  int n;
+  uint *addr;
+  if (argptr(0, (char**)&addr, sizeof(*addr)) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  return futex_wake(addr, n);
+}
+
+// restrict process of given pid to the cpus of the mask.
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+  if (argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+
+  return sched_setaffinity(pid, mask);
+}
+
+// return mask of the cpus the process may run on.
+int
+sys_sched_getaffinity(void)
+{
+  int pid;
+  if (argint(0, &pid) < 0)
+    return -1;
+
+  return sched_getaffinity(pid);
+}
+
+// restrict thread of the process to the cpus of the mask.
+int
+sys_thread_setaffinity(void)
+{
+  int tid, mask;
+  if (argint(0, &tid) < 0 || argint(1, &mask) < 0)
+    return -1;
+
+  return thread_setaffinity(tid, mask);
+}
+
+// return mask of the cpus the thread may run on.
+int
+sys_thread_getaffinity(void)
+{
+  int tid;
+  if (argint(0, &tid) < 0)
+    return -1;
+
+  return thread_getaffinity(tid);
+}
+
+// return MLFQ level of the thread in the process.
+int
+sys_thread_getlev(void)
+{
+  int tid;
+  if (argint(0, &tid) < 0)
+    return -1;
+
+  return thread_getlev(tid);
+}
+
+// reserve given proportion of the process's cpu time for the thread.
+int
+sys_thread_set_cpu_share(void)
+{
+  int tid, n;
+  if (argint(0, &tid) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  return thread_set_cpu_share(tid, n);
+}
+
 int
 sys_thread_create(void)
 {
@@ -156,3 +325,83 @@ sys_thread_join(void)
   
   return thread_join(tid, retval);
 }
+
+// reap any finished thread of the current process.
+int
+sys_thread_join_any(void)
+{
+  void **retval;
+  if (argptr(0, (char**)&retval, sizeof retval) < 0)
+    return -1;
+
+  return thread_join_any(retval);
+}
+
+// kill the other thread of the current process.
+int
+sys_thread_kill(void)
+{
+  int tid;
+  if (argint(0, &tid) < 0)
+    return -1;
+
+  return thread_kill(tid);
+}
+
+// install thread-local storage of the current thread.
+int
+sys_settls(void)
+{
+  char *base;
+  if (argptr(0, &base, 8) < 0)
+    return -1;
+
+  return settls(base);
+}
+
+// copy scheduler statistics to user space.
+int
+sys_getschedstat(void)
+{
+  struct schedstat *st;
+  if (argptr(0, (char**)&st, sizeof(*st)) < 0)
+    return -1;
+
+  getschedstat(st);
+  return 0;
+}
+
+// copy scheduler parameters to user space.
+int
+sys_getschedparam(void)
+{
+  struct schedparam *param;
+  if (argptr(0, (char**)&param, sizeof(*param)) < 0)
+    return -1;
+
+  getschedparam(param);
+  return 0;
+}
+
+// replace scheduler parameters with given ones.
+int
+sys_setschedparam(void)
+{
+  struct schedparam *param;
+  if (argptr(0, (char**)&param, sizeof(*param)) < 0)
+    return -1;
+
+  return setschedparam(param);
+}
+
+// copy cpu time of the current process to user space.
+int
+sys_getruntime(void)
+{
+  struct runtime *rt;
+  if (argptr(0, (char**)&rt, sizeof(*rt)) < 0)
+    return -1;
+
+  getruntime(rt);
+  return 0;
+}
@@ -3,7 +3,7 @@
 #include "user.h"
 
 #define NUM_THREAD 10
-#define NTEST 14
+#define NTEST 18
 
 // Show race condition
 int racingtest(void);
@@ -41,6 +41,18 @@ int sleeptest(void);
 // Test behavior when we use cpu_share with thread
 int stridetest(void);
 
+// Test threads of a process are demoted individually
+int leveltest(void);
+
+// Test a process can have more threads than the old fixed limit
+int manytest(void);
+
+// Test thread_join_any reaps every thread once and thread_kill stops one
+int joinanytest(void);
+
+// Test thread_self and thread-local data stay private to each thread
+int tlstest(void);
+
 volatile int gcnt;
 int gpipe[2];
 
@@ -59,6 +71,10 @@ int (*testfunc[NTEST])(void) = {
   pipetest,
   sleeptest,
   stridetest,
+  leveltest,
+  manytest,
+  joinanytest,
+  tlstest,
 };
 char *testname[NTEST] = {
   "racingtest",
@@ -75,6 +91,10 @@ char *testname[NTEST] = {
   "pipetest",
   "sleeptest",
   "stridetest",
+  "leveltest",
+  "manytest",
+  "joinanytest",
+  "tlstest",
 };
 
 int
@@ -703,3 +723,254 @@ stridetest(void)
 }
 
 // ============================================================================
+
+void*
+levelthreadmain(void *arg)
+{
+  int *flag = (int*)arg;
+  while(*flag)
+    __sync_fetch_and_add(&gcnt, 1);
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+leveltest(void)
+{
+  thread_t thread;
+  int i, level, maxlevel;
+  int flag;
+  void *retval;
+
+  flag = 1;
+  if (thread_create(&thread, levelthreadmain, (void*)&flag) != 0){
+    printf(1, "panic at thread_create\n");
+    return -1;
+  }
+  if (thread_set_cpu_share(thread, 50) != 0 || thread_set_cpu_share(0, 50) == 0
+      || thread_set_cpu_share(thread, 0) != 0){
+    printf(1, "panic at thread_set_cpu_share\n");
+    return -1;
+  }
+
+  // Cpu bound thread sinks, while the sleeping one stays at the top.
+  maxlevel = 0;
+  for (i = 0; i < 150; i++){
+    sleep(1);
+    if (thread_getlev(0) != 0){
+      printf(1, "panic at level of sleeping thread\n");
+      return -1;
+    }
+    if ((level = thread_getlev(thread)) > maxlevel)
+      maxlevel = level;
+  }
+  flag = 0;
+  if (thread_join(thread, &retval) != 0){
+    printf(1, "panic at thread_join\n");
+    return -1;
+  }
+  if (maxlevel == 0){
+    printf(1, "panic at level of cpu bound thread\n");
+    return -1;
+  }
+  if (thread_getlev(thread) != -1){
+    printf(1, "panic at thread_getlev of joined thread\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// ============================================================================
+
+void*
+manythreadmain(void *arg)
+{
+  while (gcnt == 0)
+    sleep(1);
+  thread_exit((void *)((int)arg + 1));
+
+  return 0;
+}
+
+int
+manytest(void)
+{
+  const int nmany = 200;
+  thread_t threads[200];
+  int i, round;
+  void *retval;
+
+  // Second round reuses the records of the joined threads.
+  for (round = 0; round < 2; round++){
+    gcnt = 0;
+    for (i = 0; i < nmany; i++){
+      if (thread_create(&threads[i], manythreadmain, (void*)i) != 0){
+        printf(1, "panic at thread_create %d\n", i);
+        return -1;
+      }
+    }
+    gcnt = 1;
+    for (i = 0; i < nmany; i++){
+      if (thread_join(threads[i], &retval) != 0 || (int)retval != i + 1){
+        printf(1, "panic at thread_join\n");
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ============================================================================
+
+void*
+joinanythreadmain(void *arg)
+{
+  sleep((int)arg);
+  thread_exit(arg);
+
+  return 0;
+}
+
+void*
+killedthreadmain(void *arg)
+{
+  for (;;)
+    sleep(1);
+
+  return 0;
+}
+
+int
+joinanytest(void)
+{
+  thread_t threads[NUM_THREAD];
+  thread_t victim;
+  int i, tid, seen;
+  void *retval;
+
+  seen = 0;
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], joinanythreadmain, (void*)(NUM_THREAD - i)) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    tid = thread_join_any(&retval);
+    if (tid <= 0 || (int)retval < 1 || (int)retval > NUM_THREAD
+        || threads[NUM_THREAD - (int)retval] != tid || (seen & (1 << (int)retval))){
+      printf(1, "panic at thread_join_any\n");
+      return -1;
+    }
+    seen |= 1 << (int)retval;
+  }
+  if (thread_join_any(&retval) != -1 || thread_join(threads[0], &retval) != -1){
+    printf(1, "panic at join of reaped thread\n");
+    return -1;
+  }
+
+  if (thread_create(&victim, killedthreadmain, 0) != 0){
+    printf(1, "panic at thread_create\n");
+    return -1;
+  }
+  if (thread_kill(0) == 0 || thread_kill(victim) != 0
+      || thread_join(victim, &retval) != 0){
+    printf(1, "panic at thread_kill\n");
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+
+thread_t selftids[NUM_THREAD];
+
+void*
+tlsthreadmain(void *arg)
+{
+  int i;
+  int *data = thread_tls();
+
+  selftids[(int)arg] = thread_self();
+  *data = (int)arg;
+  for (i = 0; i < 100; i++){
+    yield();
+    if (*(int*)thread_tls() != (int)arg)
+      thread_exit((void *)1);
+  }
+  thread_exit(0);
+
+  return 0;
+}
+
+int
+tlstest(void)
+{
+  thread_t threads[NUM_THREAD];
+  int i, pid, fd[2];
+  int block[4];
+  char *saved, ok;
+  void *retval;
+
+  if (thread_self() <= 0){
+    printf(1, "panic at thread_self of main thread\n");
+    return -1;
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_create(&threads[i], tlsthreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create\n");
+      return -1;
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++){
+    if (thread_join(threads[i], &retval) != 0 || retval != 0
+        || selftids[i] != threads[i]){
+      printf(1, "panic at thread-local data\n");
+      return -1;
+    }
+  }
+
+  // Forked child reads its own thread ID, and reports it by a byte.
+  if (pipe(fd) < 0){
+    printf(1, "panic at pipe\n");
+    return -1;
+  }
+  if ((pid = fork()) < 0){
+    printf(1, "panic at fork\n");
+    return -1;
+  }
+  if (pid == 0){
+    close(fd[0]);
+    ok = thread_self() != selftids[0] && thread_self() > 0;
+    write(fd[1], &ok, 1);
+    close(fd[1]);
+    exit();
+  }
+  close(fd[1]);
+  if (read(fd[0], &ok, 1) != 1 || !ok){
+    printf(1, "panic at thread_self of child\n");
+    return -1;
+  }
+  close(fd[0]);
+  wait();
+
+  // Block installed by the thread, then the original one restored.
+  saved = (char*)thread_tls() - 8;
+  *(int*)thread_tls() = 7;
+  block[2] = 42;
+  if (settls(block) != 0 || thread_tls() != &block[2] || *(int*)thread_tls() != 42
+      || block[0] != thread_self()){
+    printf(1, "panic at settls\n");
+    return -1;
+  }
+  if (settls(saved) != 0 || thread_tls() != saved + 8 || *(int*)thread_tls() != 7
+      || block[0] != thread_self()){
+    printf(1, "panic at settls restore\n");
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
@@ -0,0 +1,176 @@
+// Hierarchical timer wheel.
+// Timer of the level l waits in the slot indexed by the bits
+// [l*WHEELBITS, (l+1)*WHEELBITS) of its expiry tick, where l is the
+// lowest level covering the time left. When the lower bits of the clock
+// wrap around, the slot of the upper level is cascaded to the lower levels,
+// so that each tick only looks at the timers expiring in that tick.
+// Caller serializes the wheel, see timerintr() in proc.c.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+
+#define WHEELBITS   6
+#define NSLOT       (1 << WHEELBITS)    // slots per level
+#define NLEVEL      4                   // levels, up to 2^24 ticks
+#define FAR         (1u << (WHEELBITS * NLEVEL))
+
+static struct {
+  uint now;                             // tick processed most recently
+  volatile uint next;                   // no timer expires before this tick
+  struct timer slot[NLEVEL][NSLOT];     // list heads of pending timers
+} wheel;
+
+// Is tick `a` before tick `b`, wrapping around safely.
+static int
+before(uint a, uint b)
+{
+  return (int)(a - b) < 0;
+}
+
+static void
+link(struct timer *head, struct timer *tm)
+{
+  tm->next = head;
+  tm->prev = head->prev;
+  head->prev->next = tm;
+  head->prev = tm;
+}
+
+static void
+unlink(struct timer *tm)
+{
+  tm->prev->next = tm->next;
+  tm->next->prev = tm->prev;
+  tm->next = 0;
+  tm->prev = 0;
+}
+
+// Link timer to the slot for its expiry, not before the current tick.
+// Timer further than the wheel waits at the last level,
+// and it is placed again whenever cascaded.
+static void
+place(struct timer *tm)
+{
+  int level;
+  uint delta = tm->expire - wheel.now;
+  uint expire = tm->expire;
+
+  for (level = 0; level < NLEVEL - 1; ++level)
+    if (delta < 1u << (WHEELBITS * (level + 1)))
+      break;
+  if (delta >= FAR)
+    expire = wheel.now + FAR - 1;
+
+  link(&wheel.slot[level][(expire >> (WHEELBITS * level)) & (NSLOT - 1)], tm);
+}
+
+// Earliest expiry of the timers, or far future if none.
+// The first non-empty slot of each level after the current one
+// holds the earliest timers of the level.
+static uint
+earliest(void)
+{
+  int level, i;
+  uint idx, best = wheel.now + FAR;
+  struct timer *head, *tm;
+
+  for (level = 0; level < NLEVEL; ++level)
+    for (i = 1; i <= NSLOT; ++i) {
+      idx = ((wheel.now >> (WHEELBITS * level)) + i) & (NSLOT - 1);
+      head = &wheel.slot[level][idx];
+      if (head->next == head)
+        continue;
+      for (tm = head->next; tm != head; tm = tm->next)
+        if (before(tm->expire, best))
+          best = tm->expire;
+      break;
+    }
+  return best;
+}
+
+void
+timerinit(uint now)
+{
+  int i, j;
+
+  wheel.now = now;
+  wheel.next = now + FAR;
+  for (i = 0; i < NLEVEL; ++i)
+    for (j = 0; j < NSLOT; ++j)
+      wheel.slot[i][j].next = wheel.slot[i][j].prev = &wheel.slot[i][j];
+}
+
+// Arm timer to expire at given tick.
+// Timer already expired fires in the next tick.
+void
+timeradd(struct timer *tm, uint expire)
+{
+  if (tm->next)
+    unlink(tm);
+  if (before(expire, wheel.now + 1))
+    expire = wheel.now + 1;
+  tm->expire = expire;
+  place(tm);
+  if (before(expire, wheel.next))
+    wheel.next = expire;
+}
+
+// Disarm timer if pending.
+void
+timerdel(struct timer *tm)
+{
+  if (tm->next)
+    unlink(tm);
+}
+
+// Advance the wheel up to tick `now`,
+// and move the expired timers to the list `expired`.
+void
+timeradvance(uint now, struct timer *expired)
+{
+  int level;
+  uint idx;
+  struct timer *head, *tm;
+
+  while (before(wheel.now, now)) {
+    wheel.now++;
+
+    // Cascade upper levels first, so that timers
+    // moving down are cascaded again in the same tick.
+    for (level = NLEVEL - 1; level > 0; --level) {
+      if (wheel.now & ((1u << (WHEELBITS * level)) - 1))
+        continue;
+      idx = (wheel.now >> (WHEELBITS * level)) & (NSLOT - 1);
+      head = &wheel.slot[level][idx];
+      while ((tm = head->next) != head) {
+        unlink(tm);
+        place(tm);
+      }
+    }
+
+    head = &wheel.slot[0][wheel.now & (NSLOT - 1)];
+    while ((tm = head->next) != head) {
+      unlink(tm);
+      if (before(wheel.now, tm->expire))
+        place(tm);
+      else
+        link(expired, tm);
+    }
+  }
+
+  // Deleted timers may leave the hint early, it is found again lazily.
+  if (!before(wheel.now, wheel.next))
+    wheel.next = earliest();
+}
+
+// No timer expires before the returned tick.
+// It is read without the lock for programming the timer interrupt
+// of the timekeeper cpu.
+uint
+timerpeek(void)
+{
+  return wheel.next;
+}
@@ -0,0 +1,106 @@
+// Scheduler event trace.
+// Each cpu records its events in its own ring without locking,
+// with interrupts disabled, and the reader drains the rings by
+// advancing their tails. Ring full of undrained events drops the new
+// ones. Event sites test `tracing` first, see TRACE() in defs.h,
+// so that tracing costs a load and a branch while disabled.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
+#include "mlfq.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+
+#define NTRACE      512   // events per ring, power of two
+
+static struct {
+  struct traceev ev[NTRACE];
+  volatile uint head;     // next event to write, by the owner cpu
+  volatile uint tail;     // next event to read, by the reader
+} rings[NCPU];
+
+// Serializes the readers of the rings.
+static struct spinlock tracelock;
+
+volatile int tracing;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+// Record the event of the thread, or of the run queue if `p` is zero.
+void
+trace(int type, struct proc *p, struct thread *t)
+{
+  uint head;
+  struct traceev *ev;
+  struct cpu *c;
+
+  pushcli();
+  c = mycpu();
+  head = rings[c - cpus].head;
+  if (head - rings[c - cpus].tail >= NTRACE) {
+    c->rq->stat.ntrlost++;
+    popcli();
+    return;
+  }
+
+  ev = &rings[c - cpus].ev[head % NTRACE];
+  ev->tsc = rdtsc();
+  ev->type = type;
+  ev->cpu = c - cpus;
+  ev->pid = p ? p->pid : 0;
+  ev->tid = t ? t->tid : 0;
+  ev->level = p && p->mlfq.level < 0 ? p->mlfq.level : t ? t->mlfq.level : 0;
+  // Event is written before the reader sees it.
+  __sync_synchronize();
+  rings[c - cpus].head = head + 1;
+  popcli();
+}
+
+// Enable tracing if `on` is non-zero, events recorded before are discarded.
+// It returns whether tracing was enabled.
+int
+settrace(int on)
+{
+  int i, was;
+
+  acquire(&tracelock);
+  was = tracing;
+  if (on && !was)
+    for (i = 0; i < ncpu; ++i)
+      rings[i].tail = rings[i].head;
+  tracing = on != 0;
+  release(&tracelock);
+  return was;
+}
+
+// Drain up to `n` events from the rings of every cpu into `buf`.
+// Events are in order per cpu, reader merges them by TSC.
+// It returns the number of events copied.
+int
+gettrace(struct traceev *buf, int n)
+{
+  int i, k = 0;
+  uint tail, head;
+
+  acquire(&tracelock);
+  for (i = 0; i < ncpu && k < n; ++i) {
+    head = rings[i].head;
+    // Head is read before the events it covers.
+    __sync_synchronize();
+    for (tail = rings[i].tail; tail != head && k < n; ++tail)
+      buf[k++] = rings[i].ev[tail % NTRACE];
+    __sync_synchronize();
+    rings[i].tail = tail;
+  }
+  release(&tracelock);
+  return k;
+}
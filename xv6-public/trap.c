@@ -2,22 +2,29 @@
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
+#include "spinlock.h"
+#include "schedstat.h"
 #include "mlfq.h"
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
+#include "clock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+uint tickcycles;    // TSC cycles per tick, calibrated by lapicinit()
+struct clock *uclock;   // clock page shared with user
 
-// For preventing improper cpu yield for MLFQ.
-extern int sys_uptime();
-extern struct mlfq mlfq;
+// Ticks are derived from TSC since boot,
+// because the timer of idle cpu skips ticks, see clockarm().
+#define MAXALARM    400     // longest one-shot timer of cpu 0 (ticks)
+static volatile int tickless;   // if non-zero, ticks are derived from TSC
+static uint64 basetsc;          // TSC at the tick `baseticks`
+static uint baseticks;
 
 void
 tvinit(void)
@@ -29,6 +36,100 @@ tvinit(void)
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
 
   initlock(&tickslock, "time");
+
+  if((uclock = (struct clock*)kalloc()) == 0)
+    panic("tvinit: clock page");
+  memset(uclock, 0, PGSIZE);
+
+  // Start counting ticks from TSC.
+  baseticks = uclock->baseticks = ticks;
+  basetsc = uclock->basetsc = rdtsc();
+  uclock->tickcycles = tickcycles;
+  tickless = 1;
+}
+
+// Read ticks without tickslock, counted from TSC which does not stop.
+uint
+readticks(void)
+{
+  uint64 tsc;
+
+  if (!tickless)
+    return *(volatile uint*)&ticks;
+  // TSC of the other cpu may fall a little behind.
+  tsc = rdtsc();
+  if (tsc < basetsc)
+    tsc = basetsc;
+  return baseticks + div64(tsc - basetsc, tickcycles);
+}
+
+// TSC at the beginning of the tick.
+static uint64
+ticktsc(uint tick)
+{
+  return basetsc + (uint64)(tick - baseticks) * tickcycles;
+}
+
+// Advance the clock on the timekeeper cpu 0,
+// and wake up the sleepers of which deadline expired.
+static void
+clockintr(void)
+{
+  acquire(&tickslock);
+  ticks = readticks();
+  // Publish to user.
+  uclock->ticks = ticks;
+  release(&tickslock);
+
+  timerintr();
+}
+
+// Program the timer of this cpu for the next event,
+// with interrupts disabled. Running thread competing with the others
+// needs the interrupt after `timeout` cycles for its quantum.
+// Without the timeout the tick stops, until the next timer of the wheel
+// on the timekeeper cpu 0, and forever on the others,
+// which are woken up by IPI.
+void
+clockarm(uint64 timeout)
+{
+  uint now;
+  uint next;
+  uint64 tsc, alarm;
+  struct cpu *c = mycpu();
+
+  if (!tickless)
+    return;
+  c->tickless = timeout == 0;
+  if (c == &cpus[0]) {
+    // Timer added meanwhile either sees the alarm or is seen here.
+    now = readticks();
+    c->alarm = now + MAXALARM;
+    __sync_synchronize();
+    next = timerpeek();
+    if ((int)(next - c->alarm) < 0)
+      c->alarm = next;
+
+    tsc = rdtsc();
+    alarm = ticktsc(c->alarm);
+    alarm = alarm > tsc ? alarm - tsc : 1;
+    if (timeout == 0 || alarm < timeout)
+      timeout = alarm;
+  }
+  lapictimer(timeout);
+}
+
+// Timer of the wheel is added for the tick.
+// Timekeeper cpu armed past the tick re-arms its timer.
+void
+clockwake(uint tick)
+{
+  struct cpu *c = &cpus[0];
+
+  __sync_synchronize();
+  if (tickless && c->tickless && (int)(tick - c->alarm) < 0
+      && c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
 }
 
 void
@@ -44,26 +145,39 @@ trap(struct trapframe *tf)
   struct proc *p = myproc();
   struct thread *t = 0;
   if (p)
-    t = &p->threads[p->tidx];
+    t = mythread();
 
   if(tf->trapno == T_SYSCALL){
-    if(p->killed)
+    if(killed())
       exit();
     t->tf = tf;
     syscall();
-    if(p->killed)
+    if(killed())
       exit();
     return;
   }
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    mycpu()->rq->stat.ntimer++;
+    if(cpuid() == 0)
+      clockintr();
+    // Scheduler re-arms the timer when the cpu enters it.
+    clockarm(p ? sched_timeout(mycpu()->rq, p) : cycles(TICKUS));
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Halted cpu is woken up to find runnable process,
+    // or running thread is preempted below.
+    // Thread running without tick gets competition, or timer is added.
+    if(p)
+      clockarm(sched_timeout(mycpu()->rq, p));
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLB:
+    // Other cpu has unmapped pages of the running process.
+    lcr3(rcr3());
+    mycpu()->tlbgen++;
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -107,19 +221,25 @@ trap(struct trapframe *tf)
   // Force process exit if it has been killed and is in user space.
   // (If it is still executing in the kernel, let it keep running
   // until it gets to the regular system call return.)
-  if(p && p->killed && (tf->cs&3) == DPL_USER)
+  if(p && killed() && (tf->cs&3) == DPL_USER)
     exit();
 
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
   if (p && t->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER) {
-    if (mlfq_yieldable(&mlfq, p))
+    if (sched_yieldable(p->mlfq.rq, p)) {
+      TRACE(TR_PREEMPT, p, t);
       yield();
-    else
+    } else
       next_thread(p);
+  } else if (p && t->state == RUNNING && tf->trapno == T_IRQ0+IRQ_WAKEUP
+             && sched_yieldable(p->mlfq.rq, p)) {
+    // Process woken up on this cpu preempts the running one.
+    TRACE(TR_PREEMPT, p, t);
+    yield();
   }
 
   // Check if the process has been killed since we yielded
-  if(p && p->killed && (tf->cs&3) == DPL_USER)
+  if(p && killed() && (tf->cs&3) == DPL_USER)
     exit();
 }
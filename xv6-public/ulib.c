@@ -3,6 +3,9 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "clock.h"
+#include "param.h"
+#include "schedstat.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +107,65 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Read ticks from the clock page, without system call.
+// Timer of idle cpu skips ticks, so count them from TSC.
+uint
+uptime_fast(void)
+{
+  volatile struct clock *c = (volatile struct clock*)USERCLOCK;
+  uint64 tsc;
+
+  tsc = rdtsc();
+  if (tsc < c->basetsc)
+    tsc = c->basetsc;
+  return c->baseticks + div64(tsc - c->basetsc, c->tickcycles);
+}
+
+// Convert TSC cycles to microseconds, by the clock page.
+uint
+cycles2us(uint64 cycles)
+{
+  volatile struct clock *c = (volatile struct clock*)USERCLOCK;
+
+  return div64(cycles * TICKUS, c->tickcycles);
+}
+
+// Consume given ticks of cpu time.
+void
+work(int ticks)
+{
+  struct runtime rt;
+  uint64 end;
+
+  getruntime(&rt);
+  end = rt.cycles + (uint64)rt.tickcycles * ticks;
+  while (rt.cycles < end)
+    getruntime(&rt);
+}
+
+static int hogpids[NCPU];
+
+// Fork n children spinning on the cpu, up to NCPU of them.
+void
+hogs(int n)
+{
+  int i;
+
+  for (i = 0; i < n && i < NCPU; ++i)
+    if ((hogpids[i] = fork()) == 0)
+      for (;;)
+        ;
+}
+
+// Kill and reap the children forked by hogs(n).
+void
+killhogs(int n)
+{
+  int i;
+
+  for (i = 0; i < n && i < NCPU; ++i) {
+    kill(hogpids[i]);
+    wait();
+  }
+}
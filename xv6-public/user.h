@@ -1,8 +1,43 @@
 struct stat;
 struct rtcdate;
+struct schedstat;
+struct runtime;
+struct schedparam;
+struct dlstat;
+struct traceev;
+struct worker;
 
 typedef int thread_t;
 
+// Synchronization of threads, see usync.c.
+typedef struct {
+  volatile uint state;    // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+  volatile uint seq;      // incremented by every signal
+} cond_t;
+
+typedef struct {
+  volatile uint arrived;  // threads arrived in the phase
+  volatile uint phase;    // incremented when every thread arrived
+  uint n;                 // threads to wait for
+} barrier_t;
+
+typedef struct {
+  volatile uint state;    // number of readers, or the writer bit
+  volatile uint seq;      // incremented by every release
+  volatile uint nwait;    // threads waiting for the release
+} rwlock_t;
+
+// Task of the work-stealing runtime, see utask.c.
+typedef struct {
+  void (*fn)(void*);      // function of the task
+  void *arg;              // argument of fn
+  volatile uint done;     // non-zero once fn returned
+  struct worker *volatile thief;  // worker stealing the task, if any
+} task_t;
+
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
@@ -33,6 +68,28 @@ int set_cpu_share(int);
 int thread_create(thread_t*, void*(*)(void*), void*);
 int thread_exit(void*);
 int thread_join(thread_t, void**);
+int thread_join_any(void**);
+int thread_kill(thread_t);
+int getschedstat(struct schedstat*);
+int getruntime(struct runtime*);
+int thread_getlev(thread_t);
+int thread_set_cpu_share(thread_t, int);
+int getschedparam(struct schedparam*);
+int setschedparam(struct schedparam*);
+int set_latency(int, int);
+int set_cpu_fraction(int, int);
+int sched_setaffinity(int, uint);
+int sched_getaffinity(int);
+int thread_setaffinity(thread_t, uint);
+int thread_getaffinity(thread_t);
+int set_deadline(int, int, int);
+int getdeadline(struct dlstat*);
+int set_gang(int);
+int settrace(int);
+int gettrace(struct traceev*, int);
+int futex_wait(uint*, uint, int);
+int futex_wake(uint*, int);
+int settls(void*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -44,6 +101,58 @@ void printf(int, const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
+uint uptime_fast(void);
+uint cycles2us(uint64);
+void work(int);
+void hogs(int);
+void killhogs(int);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+
+// usync.c
+uint atomic_add(volatile uint*, uint);
+uint atomic_xchg(volatile uint*, uint);
+int atomic_cas(volatile uint*, uint, uint);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+int mutex_trylock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
+void barrier_init(barrier_t*, uint);
+int barrier_wait(barrier_t*);
+void rwlock_init(rwlock_t*);
+void rwlock_rdlock(rwlock_t*);
+void rwlock_wrlock(rwlock_t*);
+void rwlock_unlock(rwlock_t*);
+
+// utask.c
+int task_init(int);
+void task_exit(void);
+void task_spawn(task_t*, void (*)(void*), void*);
+void task_sync(task_t*);
+
+// Thread ID of the calling thread from its thread-local storage,
+// a single load without system call, see settls().
+static inline thread_t
+thread_self(void)
+{
+  thread_t tid;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (tid));
+  return tid;
+}
+
+// Thread-local data of the calling thread, following the thread ID
+// and the base. Block of thread_create() has TLSSIZE - 8 bytes.
+static inline void*
+thread_tls(void)
+{
+  char *base;
+
+  asm volatile("movl %%gs:4, %0" : "=r" (base));
+  return base + 8;
+}
@@ -0,0 +1,225 @@
+// Synchronization of threads in user space.
+// Uncontended lock and unlock are atomic instructions only.
+// Contended threads spin for a while, since the holder running on
+// the other cpu may release soon, then block in the kernel by
+// futex_wait() on the lock word, instead of spinning or yielding
+// through the quanta of the holder.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define SPIN        100           // polls before blocking
+#define WAKEALL     0x7fffffff    // wakes every waiter
+#define RW_WRITER   0x80000000    // state of rwlock held by the writer
+
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Add `v` to the word, returning its old value.
+uint
+atomic_add(volatile uint *p, uint v)
+{
+  return __sync_fetch_and_add(p, v);
+}
+
+// Store `v` to the word, returning its old value.
+uint
+atomic_xchg(volatile uint *p, uint v)
+{
+  return __sync_lock_test_and_set(p, v);
+}
+
+// Store `new` to the word if it holds `old`, returning whether stored.
+int
+atomic_cas(volatile uint *p, uint old, uint new)
+{
+  return __sync_bool_compare_and_swap(p, old, new);
+}
+
+void
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+}
+
+// Take the lock marking it contended, so that unlock wakes a waiter.
+static void
+lockslow(mutex_t *m)
+{
+  while (atomic_xchg(&m->state, 2) != 0)
+    futex_wait((uint*)&m->state, 2, 0);
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+  int i;
+  uint c;
+
+  for (i = 0; i < SPIN; ++i) {
+    c = __sync_val_compare_and_swap(&m->state, 0, 1);
+    if (c == 0)
+      return;
+    // Others are blocked already, join them.
+    if (c == 2)
+      break;
+    pause();
+  }
+  lockslow(m);
+}
+
+// It returns zero if the lock is taken.
+int
+mutex_trylock(mutex_t *m)
+{
+  return atomic_cas(&m->state, 0, 1) ? 0 : -1;
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  // Waiters might be blocked, wake one of them.
+  if (atomic_add(&m->state, -1) != 1) {
+    m->state = 0;
+    futex_wake((uint*)&m->state, 1);
+  }
+}
+
+void
+cond_init(cond_t *c)
+{
+  c->seq = 0;
+}
+
+// Release the mutex and wait for the signal, taking the mutex again.
+// Caller checks its condition again, since wakeups may be spurious.
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+  uint seq = c->seq;
+
+  mutex_unlock(m);
+  // Signal after the unlock changed the sequence, it does not block.
+  futex_wait((uint*)&c->seq, seq, 0);
+  lockslow(m);
+}
+
+void
+cond_signal(cond_t *c)
+{
+  atomic_add(&c->seq, 1);
+  futex_wake((uint*)&c->seq, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+  atomic_add(&c->seq, 1);
+  futex_wake((uint*)&c->seq, WAKEALL);
+}
+
+void
+barrier_init(barrier_t *b, uint n)
+{
+  b->arrived = 0;
+  b->phase = 0;
+  b->n = n;
+}
+
+// Wait until `n` threads arrive. The last one to arrive opens the next
+// phase, and only that one gets non-zero returned.
+int
+barrier_wait(barrier_t *b)
+{
+  int i;
+  uint phase = b->phase;
+
+  if (atomic_add(&b->arrived, 1) == b->n - 1) {
+    // Others wait for the phase, they cannot arrive again meanwhile.
+    b->arrived = 0;
+    atomic_add(&b->phase, 1);
+    futex_wake((uint*)&b->phase, WAKEALL);
+    return 1;
+  }
+
+  for (i = 0; i < SPIN && b->phase == phase; ++i)
+    pause();
+  while (b->phase == phase)
+    futex_wait((uint*)&b->phase, phase, 0);
+  return 0;
+}
+
+void
+rwlock_init(rwlock_t *rw)
+{
+  rw->state = 0;
+  rw->seq = 0;
+  rw->nwait = 0;
+}
+
+// Wait for the release after reading the sequence `seq`.
+static void
+rwblock(rwlock_t *rw, uint seq)
+{
+  atomic_add(&rw->nwait, 1);
+  futex_wait((uint*)&rw->seq, seq, 0);
+  atomic_add(&rw->nwait, -1);
+}
+
+// Readers share the lock while no writer holds it.
+// Readers are preferred, writer waits until every reader leaves.
+void
+rwlock_rdlock(rwlock_t *rw)
+{
+  int i = 0;
+  uint s, seq;
+
+  for (;;) {
+    seq = rw->seq;
+    s = rw->state;
+    if (!(s & RW_WRITER)) {
+      if (atomic_cas(&rw->state, s, s + 1))
+        return;
+    } else if (++i < SPIN)
+      pause();
+    else
+      rwblock(rw, seq);
+  }
+}
+
+void
+rwlock_wrlock(rwlock_t *rw)
+{
+  int i = 0;
+  uint seq;
+
+  for (;;) {
+    seq = rw->seq;
+    if (rw->state == 0) {
+      if (atomic_cas(&rw->state, 0, RW_WRITER))
+        return;
+    } else if (++i < SPIN)
+      pause();
+    else
+      rwblock(rw, seq);
+  }
+}
+
+// Release the lock held by the writer or a reader,
+// the last one leaving wakes the waiters.
+void
+rwlock_unlock(rwlock_t *rw)
+{
+  if (rw->state == RW_WRITER)
+    rw->state = 0;
+  else if (atomic_add(&rw->state, -1) != 1)
+    return;
+
+  atomic_add(&rw->seq, 1);
+  if (rw->nwait)
+    futex_wake((uint*)&rw->seq, WAKEALL);
+}
@@ -0,0 +1,263 @@
+// Work-stealing task runtime in user space.
+// A fixed pool of worker threads, the calling thread included, runs
+// the tasks. Each worker pushes and pops its spawned tasks at the
+// bottom of its own Chase-Lev deque without locking, and idle workers
+// steal the oldest tasks from the top of random victims.
+// Tasks are allocated by the spawner, typically on its stack, and
+// must be synced in the reverse order of their spawns. A worker
+// waiting for a stolen task steals back from the thief only, so its
+// stack grows with the depth of the task tree only.
+// Worker of the calling thread is found in its thread-local storage.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+
+#define NDEQUE      256           // tasks per deque, power of two
+#define SPIN        64            // failed rounds before yielding
+#define NAP         (SPIN * 4)    // failed rounds before sleeping
+
+struct worker {
+  volatile int top;               // next task to steal
+  volatile int bottom;            // next task to push
+  task_t *deque[NDEQUE];
+  thread_t tid;
+  uint seed;                      // of the victim selection
+};
+
+static struct {
+  struct worker *workers;
+  int n;
+  volatile int stop;
+  volatile uint seq;              // incremented by spawns waking sleepers
+  volatile uint nsleep;           // idle workers sleeping on seq
+} pool;
+
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Worker of the calling thread, 0 if not in the pool.
+static inline struct worker*
+self(void)
+{
+  return *(struct worker**)thread_tls();
+}
+
+// Push task at the bottom, returning -1 if the deque is full.
+static int
+push(struct worker *w, task_t *t)
+{
+  int b = w->bottom;
+
+  if (b - w->top >= NDEQUE)
+    return -1;
+  w->deque[b & (NDEQUE - 1)] = t;
+  // Task is stored before the thieves see it.
+  asm volatile("" ::: "memory");
+  w->bottom = b + 1;
+  return 0;
+}
+
+// Pop task from the bottom, 0 if empty.
+// The last task races with the thieves for the top.
+static task_t*
+pop(struct worker *w)
+{
+  int t, b = w->bottom - 1;
+  task_t *task;
+
+  w->bottom = b;
+  // Bottom is stored before the top is loaded.
+  __sync_synchronize();
+  t = w->top;
+  if (t > b) {
+    w->bottom = b + 1;
+    return 0;
+  }
+  task = w->deque[b & (NDEQUE - 1)];
+  if (t == b) {
+    if (!__sync_bool_compare_and_swap(&w->top, t, t + 1))
+      task = 0;
+    w->bottom = b + 1;
+  }
+  return task;
+}
+
+// Steal task from the top of the victim, 0 if empty or lost the race.
+static task_t*
+steal(struct worker *thief, struct worker *victim)
+{
+  int t = victim->top;
+  int b = victim->bottom;
+  task_t *task;
+
+  if (t >= b)
+    return 0;
+  task = victim->deque[t & (NDEQUE - 1)];
+  if (!__sync_bool_compare_and_swap(&victim->top, t, t + 1))
+    return 0;
+  task->thief = thief;
+  return task;
+}
+
+// Steal from the victims in random order, starting from a random one.
+static task_t*
+stealany(struct worker *w)
+{
+  int i, v;
+  task_t *task;
+
+  if (pool.n < 2)
+    return 0;
+  w->seed = w->seed * 1103515245 + 12345;
+  v = (w->seed >> 16) % pool.n;
+  for (i = 0; i < pool.n; ++i, v = (v + 1) % pool.n)
+    if (&pool.workers[v] != w && (task = steal(w, &pool.workers[v])) != 0)
+      return task;
+  return 0;
+}
+
+static void
+run(task_t *t)
+{
+  t->fn(t->arg);
+  // Results of the task are stored before it is seen done.
+  __sync_synchronize();
+  t->done = 1;
+}
+
+// Back off after `misses` rounds without work. Long idle worker
+// sleeps until a spawn, or a tick since the spawn may miss it.
+static void
+idle(int misses)
+{
+  uint seq;
+
+  if (misses < SPIN)
+    pause();
+  else if (misses < NAP)
+    yield();
+  else {
+    seq = pool.seq;
+    atomic_add(&pool.nsleep, 1);
+    if (!pool.stop)
+      futex_wait((uint*)&pool.seq, seq, 1);
+    atomic_add(&pool.nsleep, -1);
+  }
+}
+
+static void*
+workermain(void *arg)
+{
+  int misses = 0;
+  struct worker *w = arg;
+  task_t *t;
+
+  *(struct worker**)thread_tls() = w;
+  while (!pool.stop) {
+    if ((t = pop(w)) != 0 || (t = stealany(w)) != 0) {
+      run(t);
+      misses = 0;
+    } else
+      idle(misses++);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+// Start the pool of `n` workers, the calling thread is the first one.
+// It returns the number of workers, or -1 on failure.
+int
+task_init(int n)
+{
+  int i;
+
+  if (pool.workers || n < 1)
+    return -1;
+  if (n > NCPU)
+    n = NCPU;
+  if ((pool.workers = malloc(n * sizeof(struct worker))) == 0)
+    return -1;
+  memset(pool.workers, 0, n * sizeof(struct worker));
+  pool.stop = 0;
+  pool.n = 1;
+
+  pool.workers[0].tid = thread_self();
+  pool.workers[0].seed = thread_self();
+  *(struct worker**)thread_tls() = &pool.workers[0];
+  for (i = 1; i < n; ++i) {
+    pool.workers[i].seed = i;
+    if (thread_create(&pool.workers[i].tid, workermain, &pool.workers[i]) != 0)
+      break;
+    pool.n++;
+  }
+  return pool.n;
+}
+
+// Stop the workers, after every spawned task is synced.
+void
+task_exit(void)
+{
+  int i;
+  void *retval;
+
+  if (pool.workers == 0 || self() != &pool.workers[0])
+    return;
+  pool.stop = 1;
+  futex_wake((uint*)&pool.seq, pool.n);
+  for (i = 1; i < pool.n; ++i)
+    thread_join(pool.workers[i].tid, &retval);
+  *(struct worker**)thread_tls() = 0;
+  free(pool.workers);
+  pool.workers = 0;
+  pool.n = 0;
+}
+
+// Spawn `fn(arg)` as task `t`, which the idle workers may steal.
+// Thread not in the pool, or with its deque full, runs it at once.
+void
+task_spawn(task_t *t, void (*fn)(void*), void *arg)
+{
+  struct worker *w = self();
+
+  t->fn = fn;
+  t->arg = arg;
+  t->done = 0;
+  t->thief = 0;
+  if (w == 0 || push(w, t) < 0) {
+    run(t);
+    return;
+  }
+  if (pool.nsleep) {
+    atomic_add(&pool.seq, 1);
+    futex_wake((uint*)&pool.seq, 1);
+  }
+}
+
+// Wait until task `t` is done, running it if not stolen,
+// or the tasks spawned by its thief meanwhile.
+void
+task_sync(task_t *t)
+{
+  int misses = 0;
+  struct worker *w = self();
+  struct worker *thief;
+  task_t *task;
+
+  while (!t->done) {
+    if ((task = pop(w)) != 0
+        || ((thief = t->thief) != 0 && (task = steal(w, thief)) != 0)) {
+      run(task);
+      misses = 0;
+    } else if (misses++ < SPIN)
+      pause();
+    else
+      yield();
+  }
+  // Results of the task are loaded after it is seen done.
+  __sync_synchronize();
+}
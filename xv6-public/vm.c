@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "clock.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -152,14 +153,15 @@ switchkvm(void)
   lcr3(V2P(kpgdir));   // switch to the kernel page table
 }
 
-// Switch TSS and h/w page table to correspond to process p.
+// Switch TSS and h/w page table to correspond to process p,
+// with the kernel stack of the thread running on this cpu.
 void
 switchuvm(struct proc *p)
 {
   struct thread *t;
   if(p == 0)
     panic("switchuvm: no process");
-  t = &p->threads[p->tidx];
+  t = mythread();
   if(t->kstack == 0)
     panic("switchuvm: no kstack");
   if(p->pgdir == 0)
@@ -175,25 +177,19 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  loadtls(t);
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
 
-// Switch default kernel stack for trap,
-// syscall and privilege escalation.
+// Install thread-local storage segment of the thread on this cpu.
+// User %gs selects it, reloaded from the trap frame
+// on the return to user space.
 void
-switch_trap_kstack(struct proc *p)
+loadtls(struct thread *t)
 {
-  struct thread *t;
-  if(p == 0)
-    panic("switchuvm: no process");
-  t = &p->threads[p->tidx];
-  if(t->kstack == 0)
-    panic("switchuvm: no kstack");
-
   pushcli();
-  // switch default kernel stack to current thread.
-  mycpu()->ts.esp0 = (uint)t->kstack + KSTACKSIZE;
+  mycpu()->gdt[SEG_UTLS] = SEG(STA_W, t->tls, 0xffffffff, DPL_USER);
   popcli();
 }
 
@@ -210,6 +206,8 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memset(mem, 0, PGSIZE);
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
+  if(mapclock(pgdir) < 0)
+    panic("inituvm: clock page");
 }
 
 // Load a program segment into pgdir.  addr must be page-aligned
@@ -244,7 +242,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > USERCLOCK)
     return 0;
   if(newsz < oldsz)
     return oldsz;
@@ -298,6 +296,35 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Unmap user pages like deallocuvm, but store the pages to pages[]
+// instead of freeing them, and return the number of them.
+// Caller frees them once no TLB can refer to them.
+int
+unmapuvm(pde_t *pgdir, uint oldsz, uint newsz, char **pages)
+{
+  pte_t *pte;
+  uint a, pa;
+  int n = 0;
+
+  if(newsz >= oldsz)
+    return 0;
+
+  a = PGROUNDUP(newsz);
+  for(; a  < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if((*pte & PTE_P) != 0){
+      pa = PTE_ADDR(*pte);
+      if(pa == 0)
+        panic("unmapuvm");
+      pages[n++] = P2V(pa);
+      *pte = 0;
+    }
+  }
+  return n;
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -307,7 +334,8 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
+  // Clock page is shared, unmap it without freeing.
+  deallocuvm(pgdir, USERCLOCK, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -317,6 +345,13 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+// Map the clock page read-only at the top of user memory.
+int
+mapclock(pde_t *pgdir)
+{
+  return mappages(pgdir, (char*)USERCLOCK, PGSIZE, V2P(uclock), PTE_U);
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -342,6 +377,8 @@ copyuvm(pde_t *pgdir, uint sz)
 
   if((d = setupkvm()) == 0)
     return 0;
+  if(mapclock(d) < 0)
+    goto bad;
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
@@ -130,6 +130,37 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Index of the least significant set bit, mask must be non-zero.
+static inline uint
+bsf(uint mask)
+{
+  uint idx;
+  asm volatile("bsfl %1,%0" : "=r" (idx) : "rm" (mask) : "cc");
+  return idx;
+}
+
+// Divide 64-bit dividend without libgcc,
+// quotient must fit in 32-bit, otherwise it returns -1.
+static inline uint
+div64(uint64 n, uint d)
+{
+  uint q, r;
+
+  if (d == 0 || (uint)(n >> 32) >= d)
+    return -1;
+  asm volatile("divl %4" : "=a" (q), "=d" (r)
+               : "a" ((uint)n), "d" ((uint)(n >> 32)), "rm" (d));
+  return q;
+}
+
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +175,14 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().